@@ -7,10 +7,8 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QThread>
-#include <QDirIterator>
 #include <QApplication>
 #include <QLabel>
-#include <QSet>
 #include <QDebug>
 
 // Helper to split a QString
@@ -23,7 +21,7 @@ std::vector<std::string> qstringToVector(const QString& str) {
 }
 
 // A worker thread to run the conversion process without blocking the UI
-class ConverterWorker : public QObject {
+class ConverterWorker : public QObject, private ConversionObserver {
     Q_OBJECT
 
 public:
@@ -39,88 +37,59 @@ public slots:
     void doWork() {
         emit logMessage("Starting conversion...");
 
-        int totalFiles = 0;
-        QSet<QString> fileList;
-
-        for (const auto& dir : m_dirs) {
-            QDirIterator it(QString::fromStdString(dir), QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-            while (it.hasNext()) {
-                QString filePath = it.next();
-                if (!filePath.isEmpty()) {
-                    bool extensionMatch = false;
-                    for (const auto& ext : m_exts) {
-                        if (filePath.endsWith(QString::fromStdString(ext))) {
-                            extensionMatch = true;
-                            break;
-                        }
-                    }
-                    if (extensionMatch) {
-                        fileList.insert(filePath);
-                        totalFiles++;
-                    }
-                }
-            }
-        }
-        
-        emit logMessage(QString("Found %1 files to process.").arg(totalFiles));
-        if (totalFiles == 0) {
-            emit conversionFinished();
-            return;
-        }
-
-        int processedCount = 0;
-        for (const auto& file : fileList) {
-            try {
-                // Use FileConverter to convert file using the new API
-                std::string filePath = file.toStdString();
-                FileConverter::ConversionResult result = FileConverter::convertFile(
-                    filePath,
-                    m_targetEnc,
-                    m_backup,
-                    m_backupSuffix);
-                
-                // Handle the result
-                switch (result)
-                {
-                    case FileConverter::ConversionResult::Success:
-                    {
-                        // Detect source encoding for logging
-                        std::string sourceEncoding = FileConverter::detectFileEncoding(filePath);
-                        emit logMessage(QString("Successfully converted: '%1' (%2 -> %3)")
-                                      .arg(file)
-                                      .arg(QString::fromStdString(sourceEncoding))
-                                      .arg(QString::fromStdString(m_targetEnc)));
-                        break;
-                    }
-                    case FileConverter::ConversionResult::EmptyFile:
-                        emit logMessage(QString("Skipping file '%1': File is empty").arg(file));
-                        break;
-                    case FileConverter::ConversionResult::AlreadyTargetEncoding:
-                        emit logMessage(QString("Skipping file '%1': Already in target encoding").arg(file));
-                        break;
-                    case FileConverter::ConversionResult::CannotDetectEncoding:
-                        emit logMessage(QString("Skipping file '%1': Cannot detect encoding").arg(file));
-                        break;
-                    case FileConverter::ConversionResult::BackupFailed:
-                        emit logMessage(QString("Backup failed: '%1'").arg(file));
-                        break;
-                    case FileConverter::ConversionResult::ConversionFailed:
-                        emit logMessage(QString("Conversion failed: '%1'").arg(file));
-                        break;
-                }
-
-            } catch (const std::exception& e) {
-                emit logMessage(QString("Error processing '%1': %2").arg(file).arg(e.what()));
-            }
-
-            processedCount++;
-            emit conversionProgress(static_cast<int>((static_cast<float>(processedCount) / totalFiles) * 100));
+        // Scanning, reading, converting and writing overlap; fileFinished() receives the results one at a time
+        std::vector<fs::path> roots(m_dirs.begin(), m_dirs.end());
+        m_processedCount = 0;
+        try {
+            ConversionSummary summary = FileConverter::convertTree(roots, PatternMatcher(m_exts), m_targetEnc, m_backup, *this);
+            m_processedCount = static_cast<int>(summary.filesReported);
+        } catch (const std::exception& e) {
+            emit logMessage(QString("Error scanning directories: %1").arg(e.what()));
         }
 
+        emit logMessage(QString("Processed %1 files.").arg(m_processedCount));
         emit logMessage("Conversion completed.");
         emit conversionFinished();
     }
 
+private:
+    // Runs on the conversion's result thread, once per finished file; the total is an estimate until the scan finishes
+    void fileFinished(const FileConversion& conversion, const ScanProgress& progress) override {
+        const ConversionInfo& info = conversion.info;
+        QString file = QString::fromStdString(conversion.path.string());
+
+        // Handle the result
+        switch (info.result)
+        {
+            case ConversionResult::Success:
+                emit logMessage(QString("Successfully converted: '%1' (%2 -> %3)")
+                              .arg(file)
+                              .arg(QString::fromStdString(info.sourceEncoding))
+                              .arg(QString::fromStdString(m_targetEnc)));
+                break;
+            case ConversionResult::EmptyFile:
+                emit logMessage(QString("Skipping file '%1': File is empty").arg(file));
+                break;
+            case ConversionResult::AlreadyTargetEncoding:
+                emit logMessage(QString("Skipping file '%1': Already in target encoding").arg(file));
+                break;
+            case ConversionResult::CannotDetectEncoding:
+                emit logMessage(QString("Skipping file '%1': Cannot detect encoding").arg(file));
+                break;
+            case ConversionResult::BackupFailed:
+                emit logMessage(QString("Backup failed: '%1'").arg(file));
+                break;
+            case ConversionResult::ConversionFailed:
+            case ConversionResult::LibraryFailure:
+                emit logMessage(QString("Conversion failed: '%1'").arg(file));
+                break;
+        }
+
+        m_processedCount++;
+        size_t totalFiles = progress.estimatedTotal();
+        emit conversionProgress(static_cast<int>((static_cast<float>(m_processedCount) / totalFiles) * 100));
+    }
+
 signals:
     void conversionProgress(int progress);
     void logMessage(const QString &message);
@@ -132,6 +101,7 @@ private:
     std::string m_targetEnc;
     bool m_backup;
     std::string m_backupSuffix;
+    int m_processedCount = 0;
 };
 
 MainWindow::MainWindow(QWidget *parent)
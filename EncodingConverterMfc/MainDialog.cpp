@@ -231,7 +231,6 @@ void CMainDialog::ScanAndConvertFiles()
     try
     {
         fs::path dirPath(CStringToString(m_dirPath));
-        std::vector<fs::path> filesToConvert;
 
         // Parse file extensions
         std::vector<std::string> extensions;
@@ -257,99 +256,19 @@ void CMainDialog::ScanAndConvertFiles()
             }
         }
 
-        // Scan for files
-        UpdateStatus(_T("Scanning for files..."));
-        for (const auto &entry : fs::recursive_directory_iterator(dirPath))
-        {
-            if (m_stopConversion)
-                break;
+        // Compile the "*.ext" patterns once; matching a file name then needs no allocations
+        PatternMatcher matchesPattern(extensions);
 
-            if (fs::is_regular_file(entry.path()))
-            {
-                std::string filename = entry.path().filename().string();
-                for (const auto &ext : extensions)
-                {
-                    if (ext.length() >= 2 && ext[0] == '*')
-                    {
-                        std::string pattern = ext.substr(1);
-                        if (filename.length() >= pattern.length() && filename.substr(filename.length() - pattern.length()) == pattern)
-                        {
-                            filesToConvert.push_back(entry.path());
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        UpdateStatus(_T("Scanning and converting files..."));
+        m_processedFiles = 0;
 
-        int totalFiles = static_cast<int>(filesToConvert.size());
-        int processedFiles = 0;
+        // Scanning, reading, converting and writing overlap; fileFinished() receives the results one at a time
+        std::string targetEncodingStr = CStringToString(m_targetEncoding);
+        ConversionSummary summary = FileConverter::convertTree({ dirPath }, matchesPattern, targetEncodingStr, m_createBackup != FALSE, *this, PipelineOptions(), &m_stopConversion);
 
+        int totalFiles = static_cast<int>(summary.filesMatched);
         AddLogMessage(CString(_T("Found ")) + StringToCString(std::to_string(totalFiles)) + _T(" files"), RGB(0, 0, 0));
 
-        // Convert files
-        for (const auto &filepath : filesToConvert)
-        {
-            if (m_stopConversion)
-                break;
-
-            processedFiles++;
-            UpdateProgress(processedFiles, totalFiles);
-            UpdateStatus(CString(_T("Converting: ")) + StringToCString(filepath.filename().string()));
-
-            try
-            {
-                std::string targetEncodingStr = CStringToString(m_targetEncoding);
-                // Convert file using the ICU-based converter with detailed info
-                ConversionInfo info = FileConverter::convertFileWithInfo(filepath, targetEncodingStr, m_createBackup);
-
-                // Format log message: filename: old_encoding -> new_encoding [status]
-                CString logMessage = StringToCString(filepath.filename().string()) + _T(": ");
-
-                if (!info.sourceEncoding.empty())
-                {
-                    logMessage += StringToCString(info.sourceEncoding) + _T(" -> ") + StringToCString(info.targetEncoding);
-                }
-                else
-                {
-                    logMessage += _T("Unknown -> ") + StringToCString(info.targetEncoding);
-                }
-
-                COLORREF textColor = RGB(0, 0, 0);
-                if (info.result == ConversionResult::Success)
-                {
-                    logMessage += _T(" [OK]");
-                    textColor = RGB(0, 128, 0); // 绿色
-                }
-                else if (info.result == ConversionResult::AlreadyTargetEncoding)
-                {
-                    logMessage += _T(" [SKIP: ") + StringToCString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMessage += _T(" - ") + StringToCString(info.errorMessage);
-                    }
-                    logMessage += _T("]");
-                    textColor = RGB(255, 140, 0); // 橙色警告
-                }
-                else
-                {
-                    logMessage += _T(" [FAILED: ") + StringToCString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMessage += _T(" - ") + StringToCString(info.errorMessage);
-                    }
-                    logMessage += _T("]");
-                    textColor = RGB(220, 20, 60); // 红色错误
-                }
-
-                AddLogMessage(logMessage, textColor);
-            }
-            catch (const std::exception &e)
-            {
-                AddLogMessage(StringToCString(filepath.filename().string()) + _T(": [FAILED: ") + StringToCString(e.what()) + _T("]"), RGB(220, 20, 60));
-            }
-        }
-
         // Final update
         if (m_stopConversion)
         {
@@ -359,7 +278,7 @@ void CMainDialog::ScanAndConvertFiles()
         else
         {
             UpdateStatus(_T("Conversion completed"));
-            AddLogMessage(CString(_T("Completed: ")) + StringToCString(std::to_string(processedFiles)) + _T(" files"), RGB(0, 128, 0));
+            AddLogMessage(CString(_T("Completed: ")) + StringToCString(std::to_string(summary.filesReported)) + _T(" files"), RGB(0, 128, 0));
         }
 
         UpdateProgress(totalFiles, totalFiles);
@@ -374,6 +293,56 @@ void CMainDialog::ScanAndConvertFiles()
     PostMessage(WM_USER + 1, 0, 0);
 }
 
+// Runs on the conversion's result thread, once per finished file
+void CMainDialog::fileFinished(const FileConversion &file, const ScanProgress &progress)
+{
+    const ConversionInfo &info = file.info;
+    m_processedFiles++;
+    UpdateProgress(m_processedFiles, static_cast<int>(progress.estimatedTotal()));
+    UpdateStatus(CString(_T("Converted: ")) + StringToCString(file.path.filename().string()));
+
+    // Format log message: filename: old_encoding -> new_encoding [status]
+    CString logMessage = StringToCString(file.path.filename().string()) + _T(": ");
+
+    if (!info.sourceEncoding.empty())
+    {
+        logMessage += StringToCString(info.sourceEncoding) + _T(" -> ") + StringToCString(info.targetEncoding);
+    }
+    else
+    {
+        logMessage += _T("Unknown -> ") + StringToCString(info.targetEncoding);
+    }
+
+    COLORREF textColor = RGB(0, 0, 0);
+    if (info.result == ConversionResult::Success)
+    {
+        logMessage += _T(" [OK]");
+        textColor = RGB(0, 128, 0); // 绿色
+    }
+    else if (info.result == ConversionResult::AlreadyTargetEncoding)
+    {
+        logMessage += _T(" [SKIP: ") + StringToCString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMessage += _T(" - ") + StringToCString(info.errorMessage);
+        }
+        logMessage += _T("]");
+        textColor = RGB(255, 140, 0); // 橙色警告
+    }
+    else
+    {
+        logMessage += _T(" [FAILED: ") + StringToCString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMessage += _T(" - ") + StringToCString(info.errorMessage);
+        }
+        logMessage += _T("]");
+        textColor = RGB(220, 20, 60); // 红色错误
+    }
+
+    AddLogMessage(logMessage, textColor);
+}
+
 void CMainDialog::AddLogMessage(const CString &message, COLORREF textColor)
 {
     // Thread-safe UI update with mutex protection
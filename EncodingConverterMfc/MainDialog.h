@@ -3,11 +3,12 @@
 #include "resource.h"
 #include "stdafx.h"
 #include "CustomRichEdit.h"
+#include "../common/ConversionObserver.hpp"
 #include <vector>
 #include <string>
 #include <filesystem>
 
-class CMainDialog : public CDialogEx
+class CMainDialog : public CDialogEx, private ConversionObserver
 {
     DECLARE_DYNAMIC(CMainDialog)
 
@@ -51,6 +52,7 @@ private:
     std::thread m_workerThread;
     std::atomic<bool> m_stopConversion;
     std::mutex m_logMutex;
+    int m_processedFiles = 0;  // Files reported so far; touched only by fileFinished() during a run
 
     // Helper methods
     void InitializeEncodings();
@@ -63,4 +65,7 @@ private:
     void UpdateStatus(const CString &status);
     void ScanAndConvertFiles();
     void SetFileExtensions(const CString &extensions);
+
+    // ConversionObserver
+    void fileFinished(const FileConversion &file, const ScanProgress &progress) override;
 };
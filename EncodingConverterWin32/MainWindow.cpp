@@ -541,7 +541,6 @@ void MainWindow::ScanAndConvertFiles()
     try
     {
         fs::path dirPath(m_dirPath);
-        std::vector<fs::path> filesToConvert;
 
         // Parse file extensions
         std::vector<std::string> extensions;
@@ -567,97 +566,20 @@ void MainWindow::ScanAndConvertFiles()
             }
         }
 
-        // Scan for files
-        PostMessage(m_hwnd, WM_UPDATE_STATUS, 0, (LPARAM) new std::wstring(L"Scanning for files..."));
-        for (const auto &entry : fs::recursive_directory_iterator(dirPath))
-        {
-            if (m_stopConversion)
-                break;
+        // Compile the "*.ext" patterns once; matching a file name then needs no allocations
+        PatternMatcher matchesPattern(extensions);
 
-            if (fs::is_regular_file(entry.path()))
-            {
-                std::string filename = entry.path().filename().string();
-                for (const auto &ext : extensions)
-                {
-                    if (ext.length() >= 2 && ext[0] == '*')
-                    {
-                        std::string pattern = ext.substr(1);
-                        if (filename.length() >= pattern.length() && filename.substr(filename.length() - pattern.length()) == pattern)
-                        {
-                            filesToConvert.push_back(entry.path());
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        PostMessage(m_hwnd, WM_UPDATE_STATUS, 0, (LPARAM) new std::wstring(L"Scanning and converting files..."));
+        m_processedFiles = 0;
 
-        int totalFiles = static_cast<int>(filesToConvert.size());
-        int processedFiles = 0;
+        // Scanning, reading, converting and writing overlap; fileFinished() receives the results one at a time
+        std::string targetEncodingStr = WStringToString(m_targetEncoding);
+        ConversionSummary summary = FileConverter::convertTree({ dirPath }, matchesPattern, targetEncodingStr, m_createBackup, *this, PipelineOptions(), &m_stopConversion);
 
+        int totalFiles = static_cast<int>(summary.filesMatched);
         std::wstring foundMsg = L"Found " + std::to_wstring(totalFiles) + L" files";
         PostMessage(m_hwnd, WM_ADD_LOG, 0, (LPARAM) new std::wstring(foundMsg));
 
-        // Convert files
-        std::string targetEncodingStr = WStringToString(m_targetEncoding);
-        for (const auto &filepath : filesToConvert)
-        {
-            if (m_stopConversion)
-                break;
-
-            processedFiles++;
-            PostMessage(m_hwnd, WM_UPDATE_PROGRESS, processedFiles, totalFiles);
-            std::wstring statusMsg = L"Converting: " + StringToWString(filepath.filename().string());
-            PostMessage(m_hwnd, WM_UPDATE_STATUS, 0, (LPARAM) new std::wstring(statusMsg));
-
-            try
-            {
-                // Convert file encoding using the new convertFileWithInfo function
-                ConversionInfo info = FileConverter::convertFileWithInfo(filepath, targetEncodingStr, m_createBackup);
-
-                std::wstring logMsg = StringToWString(filepath.filename().string()) + L": ";
-
-                if (!info.sourceEncoding.empty())
-                {
-                    logMsg += StringToWString(info.sourceEncoding) + L" -> " + StringToWString(info.targetEncoding);
-                }
-                else
-                {
-                    logMsg += L"Unknown -> " + StringToWString(info.targetEncoding);
-                }
-
-                if (info.result == ConversionResult::Success)
-                {
-                    logMsg += L" [OK]";
-                }
-                else if (info.result == ConversionResult::AlreadyTargetEncoding)
-                {
-                    logMsg += L" [SKIP: " + StringToWString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + StringToWString(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-                else
-                {
-                    logMsg += L" [FAILED: " + StringToWString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + StringToWString(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-
-                PostMessage(m_hwnd, WM_ADD_LOG, 0, (LPARAM) new std::wstring(logMsg));
-            }
-            catch (const std::exception &e)
-            {
-                std::wstring logMsg = StringToWString(filepath.filename().string()) + L": " + StringToWString(e.what());
-                PostMessage(m_hwnd, WM_ADD_LOG, 0, (LPARAM) new std::wstring(logMsg));
-            }
-        }
-
         // Final update
         if (m_stopConversion)
         {
@@ -667,7 +589,7 @@ void MainWindow::ScanAndConvertFiles()
         else
         {
             PostMessage(m_hwnd, WM_UPDATE_STATUS, 0, (LPARAM) new std::wstring(L"Conversion completed"));
-            std::wstring completedMsg = L"Completed: " + std::to_wstring(processedFiles) + L" files";
+            std::wstring completedMsg = L"Completed: " + std::to_wstring(summary.filesReported) + L" files";
             PostMessage(m_hwnd, WM_ADD_LOG, 0, (LPARAM) new std::wstring(completedMsg));
         }
 
@@ -684,6 +606,52 @@ void MainWindow::ScanAndConvertFiles()
     PostMessage(m_hwnd, WM_CONVERSION_COMPLETE, 0, 0);
 }
 
+// Runs on the conversion's result thread, once per finished file
+void MainWindow::fileFinished(const FileConversion &file, const ScanProgress &progress)
+{
+    const ConversionInfo &info = file.info;
+    m_processedFiles++;
+    PostMessage(m_hwnd, WM_UPDATE_PROGRESS, m_processedFiles, static_cast<LPARAM>(progress.estimatedTotal()));
+    std::wstring statusMsg = L"Converted: " + StringToWString(file.path.filename().string());
+    PostMessage(m_hwnd, WM_UPDATE_STATUS, 0, (LPARAM) new std::wstring(statusMsg));
+
+    std::wstring logMsg = StringToWString(file.path.filename().string()) + L": ";
+
+    if (!info.sourceEncoding.empty())
+    {
+        logMsg += StringToWString(info.sourceEncoding) + L" -> " + StringToWString(info.targetEncoding);
+    }
+    else
+    {
+        logMsg += L"Unknown -> " + StringToWString(info.targetEncoding);
+    }
+
+    if (info.result == ConversionResult::Success)
+    {
+        logMsg += L" [OK]";
+    }
+    else if (info.result == ConversionResult::AlreadyTargetEncoding)
+    {
+        logMsg += L" [SKIP: " + StringToWString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + StringToWString(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+    else
+    {
+        logMsg += L" [FAILED: " + StringToWString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + StringToWString(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+
+    PostMessage(m_hwnd, WM_ADD_LOG, 0, (LPARAM) new std::wstring(logMsg));
+}
+
 void MainWindow::OnFileTypeChange()
 {
     int sel = ComboBox_GetCurSel(m_hFileTypeCombo);
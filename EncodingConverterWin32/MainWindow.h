@@ -14,6 +14,8 @@
 #include <atomic>
 #include <filesystem>
 
+#include "../common/ConversionObserver.hpp"
+
 #pragma comment(lib, "uxtheme.lib")
 #pragma comment(lib, "dwmapi.lib")
 
@@ -43,7 +45,7 @@ namespace fs = std::filesystem;
 #define WM_UPDATE_STATUS                (WM_USER + 3)
 #define WM_ADD_LOG                      (WM_USER + 4)
 
-class MainWindow
+class MainWindow : private ConversionObserver
 {
 public:
     MainWindow();
@@ -127,4 +129,8 @@ private:
     std::thread m_workerThread;
     std::atomic<bool> m_stopConversion;
     std::mutex m_logMutex;
+    int m_processedFiles = 0;  // Files reported so far; touched only by fileFinished() during a run
+
+    // ConversionObserver
+    void fileFinished(const FileConversion &file, const ScanProgress &progress) override;
 };
\ No newline at end of file
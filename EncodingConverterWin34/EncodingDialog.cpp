@@ -287,7 +287,6 @@ void EncodingDialog::ScanAndConvertFiles()
     try
     {
         fs::path dirPath(m_dirPath);
-        std::vector<fs::path> filesToConvert;
 
         // Parse file extensions
         std::vector<std::string> extensions;
@@ -313,35 +312,17 @@ void EncodingDialog::ScanAndConvertFiles()
             }
         }
 
-        // Scan files
-        UpdateStatus(L"Scanning for files...");
-        for (const auto& entry : fs::recursive_directory_iterator(dirPath))
-        {
-            if (m_stopConversion)
-                break;
+        // Compile the "*.ext" patterns once; matching a file name then needs no allocations
+        PatternMatcher matchesPattern(extensions);
 
-            if (fs::is_regular_file(entry.path()))
-            {
-                std::string filename = entry.path().filename().string();
-                for (const auto& ext : extensions)
-                {
-                    if (ext.length() >= 2 && ext[0] == '*')
-                    {
-                        std::string pattern = ext.substr(1);
-                        if (filename.length() >= pattern.length() &&
-                            filename.substr(filename.length() - pattern.length()) == pattern)
-                        {
-                            filesToConvert.push_back(entry.path());
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        UpdateStatus(L"Scanning and converting files...");
+        m_processedFiles = 0;
 
-        int totalFiles = static_cast<int>(filesToConvert.size());
-        int processedFiles = 0;
+        // Scanning, reading, converting and writing overlap; fileFinished() receives the results one at a time
+        std::string targetEncodingStr = WStringToString(m_targetEncoding);
+        ConversionSummary summary = FileConverter::convertTree({ dirPath }, matchesPattern, targetEncodingStr, m_createBackup, *this, PipelineOptions(), &m_stopConversion);
 
+        int totalFiles = static_cast<int>(summary.filesMatched);
         std::wstring foundMsg = L"Found " + std::to_wstring(totalFiles) + L" files";
         AddLogMessage(foundMsg);
 
@@ -350,71 +331,6 @@ void EncodingDialog::ScanAndConvertFiles()
             lib::ProgressBar{this, IDC_PROGRESS_BAR}.setRange(0, totalFiles);
         });
 
-        // Convert files
-        std::string targetEncodingStr = WStringToString(m_targetEncoding);
-        for (const auto& filepath : filesToConvert)
-        {
-            if (m_stopConversion)
-                break;
-
-            processedFiles++;
-            
-            // Update progress in UI thread
-            dlg.runUiThread([this, processedFiles]() {
-                lib::ProgressBar{this, IDC_PROGRESS_BAR}.setPos(processedFiles);
-            });
-
-            std::wstring statusMsg = L"Converting: " + StringToWString(filepath.filename().string());
-            UpdateStatus(statusMsg);
-
-            try
-            {
-                // Convert file encoding using the new convertFileWithInfo function
-                ConversionInfo info = FileConverter::convertFileWithInfo(filepath, targetEncodingStr, m_createBackup);
-                
-                std::wstring logMsg = StringToWString(filepath.filename().string()) + L": ";
-                
-                if (!info.sourceEncoding.empty())
-                {
-                    logMsg += StringToWString(info.sourceEncoding) + L" -> " + StringToWString(info.targetEncoding);
-                }
-                else
-                {
-                    logMsg += L"Unknown -> " + StringToWString(info.targetEncoding);
-                }
-                
-                if (info.result == ConversionResult::Success)
-                {
-                    logMsg += L" [OK]";
-                }
-                else if (info.result == ConversionResult::AlreadyTargetEncoding)
-                {
-                    logMsg += L" [SKIP: " + StringToWString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + StringToWString(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-                else
-                {
-                    logMsg += L" [FAILED: " + StringToWString(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + StringToWString(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-                
-                AddLogMessage(logMsg);
-            }
-            catch (const std::exception& e)
-            {
-                std::wstring logMsg = StringToWString(filepath.filename().string()) + L": " + StringToWString(e.what());
-                AddLogMessage(logMsg);
-            }
-        }
-
         // Final update
         if (m_stopConversion)
         {
@@ -424,7 +340,7 @@ void EncodingDialog::ScanAndConvertFiles()
         else
         {
             UpdateStatus(L"Conversion completed");
-            std::wstring completedMsg = L"Completed: " + std::to_wstring(processedFiles) + L" files";
+            std::wstring completedMsg = L"Completed: " + std::to_wstring(summary.filesReported) + L" files";
             AddLogMessage(completedMsg);
         }
 
@@ -445,6 +361,60 @@ void EncodingDialog::ScanAndConvertFiles()
     m_isConverting = false;
 }
 
+// Runs on the conversion's result thread, once per finished file
+void EncodingDialog::fileFinished(const FileConversion& file, const ScanProgress& progress)
+{
+    const ConversionInfo& info = file.info;
+    m_processedFiles++;
+
+    // Update progress in UI thread; the range is the estimated total, which firms up as the scan proceeds
+    int totalFiles = static_cast<int>(progress.filesMatched.load());
+    dlg.runUiThread([this, processedFiles = m_processedFiles, totalFiles]() {
+        lib::ProgressBar progressBar{this, IDC_PROGRESS_BAR};
+        progressBar.setRange(0, totalFiles);
+        progressBar.setPos(processedFiles);
+    });
+
+    std::wstring statusMsg = L"Converted: " + StringToWString(file.path.filename().string());
+    UpdateStatus(statusMsg);
+
+    std::wstring logMsg = StringToWString(file.path.filename().string()) + L": ";
+
+    if (!info.sourceEncoding.empty())
+    {
+        logMsg += StringToWString(info.sourceEncoding) + L" -> " + StringToWString(info.targetEncoding);
+    }
+    else
+    {
+        logMsg += L"Unknown -> " + StringToWString(info.targetEncoding);
+    }
+
+    if (info.result == ConversionResult::Success)
+    {
+        logMsg += L" [OK]";
+    }
+    else if (info.result == ConversionResult::AlreadyTargetEncoding)
+    {
+        logMsg += L" [SKIP: " + StringToWString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + StringToWString(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+    else
+    {
+        logMsg += L" [FAILED: " + StringToWString(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + StringToWString(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+
+    AddLogMessage(logMsg);
+}
+
 void EncodingDialog::AddLogMessage(const std::wstring& message)
 {
     std::lock_guard<std::mutex> lock(m_logMutex);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <windows.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <thread>
@@ -13,7 +14,7 @@
 
 namespace fs = std::filesystem;
 
-class EncodingDialog : public lib::DialogMain {
+class EncodingDialog : public lib::DialogMain, private ConversionObserver {
 public:
     EncodingDialog();
     virtual ~EncodingDialog();
@@ -30,9 +31,10 @@ private:
     std::wstring m_targetEncoding;
     bool m_createBackup;
     bool m_isConverting;
-    bool m_stopConversion;
+    std::atomic<bool> m_stopConversion;
     std::thread m_workerThread;
     std::mutex m_logMutex;
+    int m_processedFiles = 0;  // Files reported so far; touched only by fileFinished() during a run
     HBRUSH m_backgroundBrush;  // Brush for dialog background
 
     // Initialization methods
@@ -50,6 +52,7 @@ private:
     void StartConversion();
     void StopConversion();
     void ScanAndConvertFiles();
+    void fileFinished(const FileConversion& file, const ScanProgress& progress) override;
 
     // Helper methods
     void AddLogMessage(const std::wstring& message);
@@ -225,7 +225,6 @@ void MainWindow::scanAndConvertFiles()
     try
     {
         fs::path dirPath(m_dirPath);
-        std::vector<fs::path> filesToConvert;
 
         // Parse file extensions
         std::vector<std::string> extensions;
@@ -251,98 +250,20 @@ void MainWindow::scanAndConvertFiles()
             }
         }
 
-        // Scan for files
-        updateStatus(L"Scanning for files...");
-        for (const auto &entry : fs::recursive_directory_iterator(dirPath))
-        {
-            if (m_stopConversion)
-                break;
+        // Compile the "*.ext" patterns once; matching a file name then needs no allocations
+        PatternMatcher matchesPattern(extensions);
 
-            if (fs::is_regular_file(entry.path()))
-            {
-                std::string filename = entry.path().filename().string();
-                for (const auto &ext : extensions)
-                {
-                    if (ext.length() >= 2 && ext[0] == '*')
-                    {
-                        std::string pattern = ext.substr(1);
-                        if (filename.length() >= pattern.length() && filename.substr(filename.length() - pattern.length()) == pattern)
-                        {
-                            filesToConvert.push_back(entry.path());
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        updateStatus(L"Scanning and converting files...");
+        m_processedFiles = 0;
 
-        int totalFiles = static_cast<int>(filesToConvert.size());
-        int processedFiles = 0;
+        // Scanning, reading, converting and writing overlap; fileFinished() receives the results one at a time
+        std::string targetEncodingStr = wstringToString(m_targetEncoding);
+        ConversionSummary summary = FileConverter::convertTree({ dirPath }, matchesPattern, targetEncodingStr, m_createBackup, *this, PipelineOptions(), &m_stopConversion);
 
+        int totalFiles = static_cast<int>(summary.filesMatched);
         std::wstring foundMsg = L"Found " + std::to_wstring(totalFiles) + L" files";
         addLogMessage(foundMsg);
 
-        // Convert files
-        for (const auto &filepath : filesToConvert)
-        {
-            if (m_stopConversion)
-                break;
-
-            processedFiles++;
-            updateProgress(processedFiles, totalFiles);
-
-            std::wstring statusMsg = L"Converting: " + stringToWstring(filepath.filename().string());
-            updateStatus(statusMsg);
-
-            try
-            {
-                // Convert file encoding using the new convertFile function
-                std::string targetEncodingStr = wstringToString(m_targetEncoding);
-                ConversionInfo info = FileConverter::convertFileWithInfo(filepath, targetEncodingStr, m_createBackup);
-                
-                std::wstring logMsg = stringToWstring(filepath.filename().string()) + L": ";
-                
-                if (!info.sourceEncoding.empty())
-                {
-                    logMsg += stringToWstring(info.sourceEncoding) + L" -> " + stringToWstring(info.targetEncoding);
-                }
-                else
-                {
-                    logMsg += L"Unknown -> " + stringToWstring(info.targetEncoding);
-                }
-                
-                if (info.result == ConversionResult::Success)
-                {
-                    logMsg += L" [OK]";
-                }
-                else if (info.result == ConversionResult::AlreadyTargetEncoding)
-                {
-                    logMsg += L" [SKIP: " + stringToWstring(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + stringToWstring(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-                else
-                {
-                    logMsg += L" [FAILED: " + stringToWstring(conversionResultToString(info.result));
-                    if (!info.errorMessage.empty())
-                    {
-                        logMsg += L" - " + stringToWstring(info.errorMessage);
-                    }
-                    logMsg += L"]";
-                }
-                
-                addLogMessage(logMsg);
-            }
-            catch (const std::exception &e)
-            {
-                std::wstring logMsg = stringToWstring(filepath.filename().string()) + L": " + stringToWstring(e.what());
-                addLogMessage(logMsg);
-            }
-        }
-
         // Final update
         if (m_stopConversion)
         {
@@ -352,7 +273,7 @@ void MainWindow::scanAndConvertFiles()
         else
         {
             updateStatus(L"Conversion completed");
-            std::wstring completedMsg = L"Completed: " + std::to_wstring(processedFiles) + L" files";
+            std::wstring completedMsg = L"Completed: " + std::to_wstring(summary.filesReported) + L" files";
             addLogMessage(completedMsg);
         }
 
@@ -369,6 +290,53 @@ void MainWindow::scanAndConvertFiles()
     onConversionComplete();
 }
 
+// Runs on the conversion's result thread, once per finished file
+void MainWindow::fileFinished(const FileConversion &file, const ScanProgress &progress)
+{
+    const ConversionInfo &info = file.info;
+    m_processedFiles++;
+    updateProgress(m_processedFiles, static_cast<int>(progress.estimatedTotal()));
+
+    std::wstring statusMsg = L"Converted: " + stringToWstring(file.path.filename().string());
+    updateStatus(statusMsg);
+
+    std::wstring logMsg = stringToWstring(file.path.filename().string()) + L": ";
+
+    if (!info.sourceEncoding.empty())
+    {
+        logMsg += stringToWstring(info.sourceEncoding) + L" -> " + stringToWstring(info.targetEncoding);
+    }
+    else
+    {
+        logMsg += L"Unknown -> " + stringToWstring(info.targetEncoding);
+    }
+
+    if (info.result == ConversionResult::Success)
+    {
+        logMsg += L" [OK]";
+    }
+    else if (info.result == ConversionResult::AlreadyTargetEncoding)
+    {
+        logMsg += L" [SKIP: " + stringToWstring(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + stringToWstring(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+    else
+    {
+        logMsg += L" [FAILED: " + stringToWstring(conversionResultToString(info.result));
+        if (!info.errorMessage.empty())
+        {
+            logMsg += L" - " + stringToWstring(info.errorMessage);
+        }
+        logMsg += L"]";
+    }
+
+    addLogMessage(logMsg);
+}
+
 void MainWindow::onFileTypeChange(vaca::Event &ev)
 {
     int sel = m_fileTypeCombo.getSelectedItem();
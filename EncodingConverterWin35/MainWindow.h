@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../common/ConversionObserver.hpp"
 #include "vaca/vaca/vaca.h"
 #include <atomic>
 #include <filesystem>
@@ -10,7 +11,7 @@
 
 namespace fs = std::filesystem;
 
-class MainWindow : public vaca::Frame
+class MainWindow : public vaca::Frame, private ConversionObserver
 {
 public:
     MainWindow();
@@ -48,6 +49,7 @@ private:
     std::thread m_workerThread;
     std::atomic<bool> m_stopConversion;
     std::mutex m_logMutex;
+    int m_processedFiles = 0;  // Files reported so far; touched only by fileFinished() during a run
 
     // Event handlers
     void onBrowserDirectory(vaca::Event &ev);
@@ -65,6 +67,9 @@ private:
     void scanAndConvertFiles();
     void setFileExtensions(const std::wstring &extensions);
 
+    // ConversionObserver
+    void fileFinished(const FileConversion &file, const ScanProgress &progress) override;
+
     // Utility functions
     std::string wstringToString(const std::wstring &wstr);
     std::wstring stringToWstring(const std::string &str);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Small helpers shared by the benchmark programs.
+ */
+namespace bench
+{
+    /**
+     * @brief Run a callable and return the elapsed wall time in seconds.
+     */
+    template <typename Fn>
+    double measure(Fn &&fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    /**
+     * @brief Generate source-like text: mostly ASCII with a share of GBK double-byte characters.
+     *
+     * @param size Number of bytes to generate.
+     * @param gbk_percent Approximate percentage of characters that are GBK double-byte.
+     * @param seed Random seed, so runs are reproducible.
+     */
+    inline std::vector<char> makeText(size_t size, int gbk_percent, uint32_t seed)
+    {
+        static const char ascii[] = "abcdefghijklmnopqrstuvwxyz0123456789 _(){};=+\n";
+        std::mt19937 rng(seed);
+        std::vector<char> text;
+        text.reserve(size + 1);
+        while (text.size() < size)
+        {
+            if (static_cast<int>(rng() % 100) < gbk_percent && text.size() + 2 <= size)
+            {
+                text.push_back(static_cast<char>(0xB0 + rng() % 0x28));
+                text.push_back(static_cast<char>(0xA1 + rng() % 0x5E));
+            }
+            else
+            {
+                text.push_back(ascii[rng() % (sizeof(ascii) - 1)]);
+            }
+        }
+        return text;
+    }
+
+    /**
+     * @brief Generate a corpus of equally sized text files held in memory.
+     */
+    inline std::vector<std::vector<char>> makeCorpus(size_t files, size_t size, int gbk_percent)
+    {
+        std::vector<std::vector<char>> corpus;
+        corpus.reserve(files);
+        for (size_t i = 0; i < files; ++i)
+        {
+            corpus.push_back(makeText(size, gbk_percent, static_cast<uint32_t>(i)));
+        }
+        return corpus;
+    }
+
+    inline void printRow(const std::string &label, double seconds, size_t items, size_t bytes)
+    {
+        double per_item_us = items ? seconds * 1e6 / static_cast<double>(items) : 0.0;
+        double mib_per_s = seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+        std::printf("  %-28s %10.3f ms %10.2f us/file %10.1f MiB/s\n", label.c_str(), seconds * 1e3, per_item_us, mib_per_s);
+    }
+}
@@ -0,0 +1,163 @@
+// Small-file I/O cost: one open/read/close (and open/write/close) per file against BatchIo, which submits
+// each step for a batch of files through io_uring, on a synthetic tree of many small files.
+//
+// Usage: batch_io_bench [scratch_dir] [file_count] [file_size] [batch_size]
+
+#include "../common/BatchIo.hpp"
+#include "../common/MappedFile.hpp"
+#include "BenchUtil.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static uint64_t checksum(const char *data, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        sum += static_cast<unsigned char>(data[i]);
+    }
+    return sum;
+}
+
+// Write back the previous pass's dirty pages, so that they do not slow down the next pass
+static void flushDirtyPages()
+{
+#ifndef _WIN32
+    ::sync();
+#endif
+}
+
+// The synchronous write path: what the converter does for one file in place
+static bool writeWithOfstream(const fs::path &filepath, std::string_view content)
+{
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    file.close();
+    return !file.fail();
+}
+
+int main(int argc, char *argv[])
+{
+    fs::path scratch = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "encoding_converter_batch_io_bench";
+    size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+    size_t size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 2048;
+    size_t batch_size = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : BatchIo::kDefaultBatchSize;
+    const size_t files_per_directory = 1000;
+
+    BatchIo io(batch_size);
+    std::cout << "Small-file I/O, " << count << " files of " << size << " bytes, batches of " << io.batchSize() << " (warm page cache)" << std::endl;
+    if (!io.available())
+    {
+        std::cout << "  io_uring unavailable: the batched rows measure the synchronous fallback" << std::endl;
+    }
+
+    auto text = bench::makeText(size, 10, 1);
+    std::string_view content(text.data(), text.size());
+    std::vector<fs::path> files;
+    files.reserve(count);
+    double create_time = bench::measure([&] {
+        for (size_t i = 0; i < count; ++i)
+        {
+            fs::path dir = scratch / std::to_string(i / files_per_directory);
+            if (i % files_per_directory == 0)
+            {
+                fs::create_directories(dir);
+            }
+            files.push_back(dir / (std::to_string(i) + ".txt"));
+            writeWithOfstream(files.back(), content);
+        }
+    });
+    size_t total = count * size;
+    std::cout << "  tree created in " << create_time << " s" << std::endl;
+
+    uint64_t sums[2] = {};
+    double read_time = bench::measure([&] {
+        for (const auto &f : files)
+        {
+            MappedFile file(f, std::numeric_limits<size_t>::max());
+            sums[0] += checksum(file.bytes().data(), file.size());
+        }
+    });
+    bench::printRow("read: open/read/close", read_time, count, total);
+
+    double batch_read_time = bench::measure([&] {
+        std::vector<fs::path> batch;
+        std::vector<BatchRead> reads;
+        for (size_t first = 0; first < count; first += io.batchSize())
+        {
+            batch.assign(files.begin() + first, files.begin() + std::min(count, first + io.batchSize()));
+            io.read(batch, reads);
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                if (reads[i].complete)
+                {
+                    sums[1] += checksum(reads[i].data.get(), reads[i].size);
+                }
+                else
+                {
+                    MappedFile file(batch[i], std::numeric_limits<size_t>::max());
+                    sums[1] += checksum(file.bytes().data(), file.size());
+                }
+            }
+        }
+    });
+    bench::printRow("read: BatchIo", batch_read_time, count, total);
+    if (sums[0] != sums[1])
+    {
+        std::cerr << "  warning: checksums differ" << std::endl;
+    }
+
+    flushDirtyPages();
+    double write_time = bench::measure([&] {
+        for (const auto &f : files)
+        {
+            writeWithOfstream(f, content);
+        }
+    });
+    bench::printRow("write: ofstream", write_time, count, total);
+
+    size_t fallbacks = 0;
+    flushDirtyPages();
+    double batch_write_time = bench::measure([&] {
+        std::vector<BatchWrite> batch;
+        std::vector<bool> written;
+        for (size_t first = 0; first < count; first += io.batchSize())
+        {
+            batch.clear();
+            for (size_t i = first; i < std::min(count, first + io.batchSize()); ++i)
+            {
+                batch.push_back(BatchWrite{ files[i], std::string_view(), content });
+            }
+            io.write(batch, written);
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                if (!written[i])
+                {
+                    writeWithOfstream(batch[i].path, content);
+                    ++fallbacks;
+                }
+            }
+        }
+    });
+    bench::printRow("write: BatchIo", batch_write_time, count, total);
+    if (io.available() && fallbacks != 0)
+    {
+        std::cerr << "  warning: " << fallbacks << " files fell back to ofstream" << std::endl;
+    }
+
+    fs::remove_all(scratch);
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Per-file encoding detection overhead: a fresh uchardet detector per file versus a pooled detector
+// that is recycled with uchardet_reset.
+//
+// Usage: detect_bench [files] [file_size]
+
+#include "../common/DetectorPool.hpp"
+#include "BenchUtil.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static size_t detectFresh(const std::vector<std::vector<char>> &corpus)
+{
+    size_t detected = 0;
+    for (const auto &file : corpus)
+    {
+        uchardet_t detector = uchardet_new();
+        uchardet_handle_data(detector, file.data(), file.size());
+        uchardet_data_end(detector);
+        const char *charset = uchardet_get_charset(detector);
+        detected += charset && *charset ? 1 : 0;
+        uchardet_delete(detector);
+    }
+    return detected;
+}
+
+static size_t detectPooled(DetectorPool &pool, const std::vector<std::vector<char>> &corpus)
+{
+    size_t detected = 0;
+    DetectorPool::Lease lease = pool.acquire();
+    for (const auto &file : corpus)
+    {
+        uchardet_t detector = lease.get();
+        uchardet_reset(detector);
+        uchardet_handle_data(detector, file.data(), file.size());
+        uchardet_data_end(detector);
+        const char *charset = uchardet_get_charset(detector);
+        detected += charset && *charset ? 1 : 0;
+    }
+    return detected;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t files = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    size_t file_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2048;
+
+    std::cout << "Detection overhead, " << files << " files" << std::endl;
+    DetectorPool pool;
+    for (size_t size : { static_cast<size_t>(64), file_size / 4, file_size })
+    {
+        auto corpus = bench::makeCorpus(files, size, 10);
+        size_t bytes = files * size;
+        std::cout << " file size " << size << " bytes" << std::endl;
+
+        size_t fresh_hits = 0;
+        double fresh = bench::measure([&] {
+            fresh_hits = detectFresh(corpus);
+        });
+        bench::printRow("uchardet_new per file", fresh, files, bytes);
+
+        size_t pooled_hits = 0;
+        double pooled = bench::measure([&] {
+            pooled_hits = detectPooled(pool, corpus);
+        });
+        bench::printRow("pooled + uchardet_reset", pooled, files, bytes);
+
+        if (fresh_hits != pooled_hits)
+        {
+            std::cerr << "  warning: detection results differ (" << fresh_hits << " vs " << pooled_hits << ")" << std::endl;
+        }
+        std::cout << "  per-file overhead saved: " << (fresh - pooled) * 1e6 / static_cast<double>(files) << " us" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Whole-file input cost: std::ifstream into a zeroed vector (the old readFileAsBytes), a single read()
+// into an uninitialised buffer, and a memory mapping, across file-size buckets.
+//
+// Usage: read_bench [scratch_dir] [bytes_per_bucket]
+
+#include "../common/MappedFile.hpp"
+#include "BenchUtil.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::vector<char> readWithIfstream(const fs::path &filepath)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    file.seekg(0, std::ios::end);
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<char> buffer(static_cast<size_t>(size));
+    file.read(buffer.data(), size);
+    return buffer;
+}
+
+// Touch every byte so mapped pages are actually faulted in
+static uint64_t checksum(const char *data, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        sum += static_cast<unsigned char>(data[i]);
+    }
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    fs::path scratch = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "encoding_converter_read_bench";
+    size_t bucket_bytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64u << 20;
+    const size_t sizes[] = { 1u << 10, 16u << 10, 256u << 10, 4u << 20, 64u << 20 };
+
+    std::cout << "Whole-file read, ~" << (bucket_bytes >> 20) << " MiB per bucket (warm page cache)" << std::endl;
+    for (size_t size : sizes)
+    {
+        size_t count = std::max<size_t>(bucket_bytes / size, 1);
+        fs::path dir = scratch / std::to_string(size);
+        fs::create_directories(dir);
+        std::vector<fs::path> files;
+        auto text = bench::makeText(size, 10, static_cast<uint32_t>(size));
+        for (size_t i = 0; i < count; ++i)
+        {
+            files.push_back(dir / (std::to_string(i) + ".txt"));
+            std::ofstream(files.back(), std::ios::binary).write(text.data(), static_cast<std::streamsize>(text.size()));
+        }
+        size_t total = count * size;
+        std::cout << " file size " << size << " bytes, " << count << " files" << std::endl;
+
+        uint64_t sums[3] = {};
+        double ifstream_time = bench::measure([&] {
+            for (const auto &f : files)
+            {
+                auto bytes = readWithIfstream(f);
+                sums[0] += checksum(bytes.data(), bytes.size());
+            }
+        });
+        bench::printRow("ifstream + vector", ifstream_time, count, total);
+
+        double read_time = bench::measure([&] {
+            for (const auto &f : files)
+            {
+                MappedFile file(f, std::numeric_limits<size_t>::max());
+                sums[1] += checksum(file.bytes().data(), file.size());
+            }
+        });
+        bench::printRow("read()", read_time, count, total);
+
+        double mmap_time = bench::measure([&] {
+            for (const auto &f : files)
+            {
+                MappedFile file(f, 0);
+                sums[2] += checksum(file.bytes().data(), file.size());
+            }
+        });
+        bench::printRow("mmap", mmap_time, count, total);
+
+        if (sums[0] != sums[1] || sums[0] != sums[2])
+        {
+            std::cerr << "  warning: checksums differ" << std::endl;
+        }
+        fs::remove_all(dir);
+    }
+    fs::remove_all(scratch);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// UTF-8 <-> UTF-16/UTF-32 and UTF-8 <-> GB18030 throughput: the native converters versus iconv on the
+// same input, for ASCII-heavy source text and for CJK-heavy text.
+//
+// Usage: transcode_bench [size_mb] [rounds]
+
+#include "../common/GbCodec.hpp"
+#include "../common/UnicodeTranscoder.hpp"
+#include "BenchUtil.hpp"
+
+#include <cstdlib>
+#include <functional>
+#include <iconv.h>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Mostly ASCII with cjk_percent of the characters from the CJK block and a few outside the BMP
+static std::string makeUtf8(size_t size, int cjk_percent, uint32_t seed)
+{
+    static const char ascii[] = "abcdefghijklmnopqrstuvwxyz0123456789 _(){};=+\n";
+    std::mt19937 rng(seed);
+    std::string text;
+    text.reserve(size + 4);
+    unsigned char buffer[4];
+    while (text.size() < size)
+    {
+        int pick = static_cast<int>(rng() % 100);
+        if (pick < cjk_percent)
+        {
+            uint32_t cp = pick == 0 ? 0x1F600 + rng() % 0x50 : 0x4E00 + rng() % 0x5200;
+            unsigned char *end = unicode_detail::encode<UnicodeForm::Utf8>(buffer, cp);
+            text.append(reinterpret_cast<char *>(buffer), static_cast<size_t>(end - buffer));
+        }
+        else
+        {
+            text.push_back(ascii[rng() % (sizeof(ascii) - 1)]);
+        }
+    }
+    return text;
+}
+
+static bool iconvConvert(iconv_t cd, const std::string &input, std::string &output)
+{
+    iconv(cd, nullptr, nullptr, nullptr, nullptr);
+    output.resize(input.size() * 4 + 16);
+    char *in_buf = const_cast<char *>(input.data());
+    size_t in_left = input.size();
+    char *out_buf = &output[0];
+    size_t out_left = output.size();
+    if (iconv(cd, &in_buf, &in_left, &out_buf, &out_left) == (size_t)-1)
+    {
+        return false;
+    }
+    output.resize(output.size() - out_left);
+    return true;
+}
+
+// Time iconv and a native converter on the same input and check that they agree
+static void compare(const std::string &label, const std::string &input, const char *from_name, const char *to_name, int rounds,
+    const std::function<bool(const std::string &, std::string &)> &native)
+{
+    std::cout << " " << label << std::endl;
+    size_t bytes = input.size() * static_cast<size_t>(rounds);
+
+    iconv_t cd = iconv_open(to_name, from_name);
+    if (cd == (iconv_t)-1)
+    {
+        std::cerr << "  iconv does not support " << label << std::endl;
+        return;
+    }
+    std::string via_iconv;
+    double iconv_seconds = bench::measure([&] {
+        for (int i = 0; i < rounds; ++i)
+        {
+            iconvConvert(cd, input, via_iconv);
+        }
+    });
+    iconv_close(cd);
+    bench::printRow("iconv", iconv_seconds, static_cast<size_t>(rounds), bytes);
+
+    std::string via_native;
+    double native_seconds = bench::measure([&] {
+        for (int i = 0; i < rounds; ++i)
+        {
+            native(input, via_native);
+        }
+    });
+    bench::printRow("native", native_seconds, static_cast<size_t>(rounds), bytes);
+
+    if (via_native != via_iconv)
+    {
+        std::cerr << "  warning: native output differs from iconv" << std::endl;
+    }
+    std::cout << "  speedup: " << (native_seconds > 0 ? iconv_seconds / native_seconds : 0.0) << "x" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16) * 1024 * 1024;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    struct Target
+    {
+        const char *name;
+        UnicodeForm form;
+    };
+    const Target targets[] = { { "UTF-16LE", UnicodeForm::Utf16LE }, { "UTF-16BE", UnicodeForm::Utf16BE }, { "UTF-32LE", UnicodeForm::Utf32LE } };
+
+    // Built up front so that table construction is not timed
+    const GbCodec *gb18030 = GbCodec::forEncoding("GB18030");
+
+    for (int cjk_percent : { 2, 60 })
+    {
+        std::string utf8 = makeUtf8(size, cjk_percent, 1);
+        std::cout << "Input " << size / (1024 * 1024) << " MiB UTF-8, " << cjk_percent << "% CJK, " << rounds << " rounds" << std::endl;
+
+        for (const Target &target : targets)
+        {
+            std::string encoded;
+            transcodeUnicode(utf8, UnicodeForm::Utf8, target.form, encoded);
+
+            compare(std::string("UTF-8 -> ") + target.name, utf8, "UTF-8", target.name, rounds, [&](const std::string &in, std::string &out) {
+                return transcodeUnicode(in, UnicodeForm::Utf8, target.form, out);
+            });
+            compare(std::string(target.name) + " -> UTF-8", encoded, target.name, "UTF-8", rounds, [&](const std::string &in, std::string &out) {
+                return transcodeUnicode(in, target.form, UnicodeForm::Utf8, out);
+            });
+        }
+
+        if (gb18030)
+        {
+            std::string encoded;
+            gb18030->encodeFromUtf8(utf8, encoded);
+
+            compare("UTF-8 -> GB18030", utf8, "UTF-8", "GB18030", rounds, [&](const std::string &in, std::string &out) {
+                return gb18030->encodeFromUtf8(in, out);
+            });
+            compare("GB18030 -> UTF-8", encoded, "GB18030", "UTF-8", rounds, [&](const std::string &in, std::string &out) {
+                return gb18030->decodeToUtf8(in, out);
+            });
+        }
+    }
+    return 0;
+}
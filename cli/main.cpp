@@ -1,9 +1,11 @@
-﻿#include <iostream>
+﻿#include <fstream>
+#include <iostream>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <cxxopts.hpp> // Include cxxopts header
 
+#include "../common/ConsoleObserver.hpp"
 #include "../common/FileConverter.hpp"
 
 // Helper function to split strings
@@ -17,6 +19,29 @@ std::vector<std::string> splitString(const std::string& str, char delimiter) {
     return tokens;
 }
 
+// Helper function to parse sizes such as "65536", "64K" or "16M"
+size_t parseSize(const std::string& str) {
+    size_t pos = 0;
+    unsigned long long value = std::stoull(str, &pos);
+    if (pos < str.size()) {
+        switch (str[pos]) {
+        case 'k': case 'K': value <<= 10; break;
+        case 'm': case 'M': value <<= 20; break;
+        case 'g': case 'G': value <<= 30; break;
+        default: throw std::invalid_argument("Invalid size: " + str);
+        }
+    }
+    return static_cast<size_t>(value);
+}
+
+// Helper function to parse the --write-mode value
+WriteMode parseWriteMode(const std::string& str) {
+    if (str == "inplace") return WriteMode::InPlace;
+    if (str == "atomic") return WriteMode::Atomic;
+    if (str == "durable") return WriteMode::Durable;
+    throw std::invalid_argument("Invalid write mode: " + str);
+}
+
 int main(int argc, char* argv[]) {
     cxxopts::Options options("file_converter", "A tool to convert file encodings in specified directories.");
 
@@ -25,6 +50,29 @@ int main(int argc, char* argv[]) {
         ("e,exts", "Comma-separated list of file extensions to convert", cxxopts::value<std::string>())
         ("t,target", "Target encoding for conversion (e.g., UTF-8)", cxxopts::value<std::string>())
         ("b,backup", "Create backup files before conversion", cxxopts::value<bool>()->default_value("false"))
+        ("backup-pack", "Append the originals of converted files to this single pack file instead of leaving .bak files", cxxopts::value<std::string>())
+        ("compress-backups", "Compress the entries of the backup pack with zlib", cxxopts::value<bool>()->default_value("false"))
+        ("restore", "Restore every file stored in this backup pack, then exit", cxxopts::value<std::string>())
+        ("restore-to", "With --restore, restore under this directory instead of to the original paths", cxxopts::value<std::string>())
+        ("i,ignore-case", "Match file extensions regardless of case", cxxopts::value<bool>()->default_value("false"))
+        ("stream-threshold", "Stream files at least this large instead of loading them (e.g. 64M, 0 = never)", cxxopts::value<std::string>()->default_value("64M"))
+        ("chunk-size", "Bytes read per chunk when streaming (e.g. 1M)", cxxopts::value<std::string>()->default_value("1M"))
+        ("memory-ceiling", "Maximum buffer memory per file when streaming (e.g. 4M)", cxxopts::value<std::string>()->default_value("4M"))
+        ("j,jobs", "Number of threads converting files (default: number of hardware threads)", cxxopts::value<size_t>()->default_value(std::to_string(ThreadPool::defaultWorkerCount())))
+        ("scan-threads", "Number of threads listing directories", cxxopts::value<size_t>()->default_value(std::to_string(DirectoryWalker::defaultThreadCount())))
+        ("ordered", "Process files in a deterministic order (sorted, depth first)", cxxopts::value<bool>()->default_value("false"))
+        ("read-threads", "Number of threads reading files", cxxopts::value<size_t>()->default_value("2"))
+        ("readahead", "Number of files to ask the kernel to read ahead of the readers, releasing their pages once done (0 = off)", cxxopts::value<size_t>()->default_value("0"))
+        ("write-threads", "Number of threads writing converted files", cxxopts::value<size_t>()->default_value("1"))
+        ("batch-io", "Read and write small files in io_uring batches (Linux builds with io_uring; others ignore it)", cxxopts::value<bool>()->default_value("false"))
+        ("dedup-cache", "Hash file contents and convert identical files once, caching up to this many bytes of results (e.g. 256M, 0 = off)", cxxopts::value<std::string>()->default_value("0"))
+        ("write-mode", "How files are replaced: inplace, atomic (temporary file + rename) or durable (atomic, flushed to disk in batches)", cxxopts::value<std::string>()->default_value("inplace"))
+        ("sync-batch", "Files flushed to disk together in durable write mode", cxxopts::value<size_t>()->default_value(std::to_string(AtomicWriter::kDefaultBatchSize)))
+        ("audit", "Only detect encodings and print a census by encoding, extension and directory; no file is modified", cxxopts::value<bool>()->default_value("false"))
+        ("audit-depth", "Directory levels below each root to group the audit by", cxxopts::value<size_t>()->default_value("1"))
+        ("m,manifest", "Skip files unchanged since the run that wrote this manifest file, and update it", cxxopts::value<std::string>())
+        ("stats", "Write per-stage latency histograms and byte counts of the run as JSON to this file (- for standard output)", cxxopts::value<std::string>())
+        ("trace", "Write a Chrome trace of the run (every file's stages on each thread, and the queue depths) to this JSON file, for chrome://tracing or Perfetto", cxxopts::value<std::string>())
         ("h,help", "Print usage");
 
     try {
@@ -35,7 +83,26 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
-        if (!result.count("dirs") || !result.count("exts") || !result.count("target")) {
+        if (result.count("restore")) {
+            BackupPackReader pack(result["restore"].as<std::string>());
+            if (!pack.complete()) {
+                std::cerr << "Backup pack was not closed; restoring the " << pack.entries().size() << " entries recovered from it." << std::endl;
+            }
+            size_t failed = 0;
+            ResultSink<RestoredFile> sink([&failed](const RestoredFile& file) {
+                if (!file.error.empty()) {
+                    std::cerr << "Error restoring file " << file.path << ": " << file.error << std::endl;
+                    ++failed;
+                }
+            });
+            fs::path destination = result.count("restore-to") ? fs::path(result["restore-to"].as<std::string>()) : fs::path();
+            pack.restore(result["jobs"].as<size_t>(), sink, destination);
+            std::cout << "Restored " << pack.entries().size() - failed << " of " << pack.entries().size() << " files." << std::endl;
+            return failed ? 1 : 0;
+        }
+
+        bool audit = result["audit"].as<bool>();
+        if (!result.count("dirs") || !result.count("exts") || (!audit && !result.count("target"))) {
             std::cerr << "Error: Missing required arguments. Please use --help for usage." << std::endl;
             return 1;
         }
@@ -43,15 +110,97 @@ int main(int argc, char* argv[]) {
         // Parse command line arguments and split strings
         std::vector<std::string> target_dirs = splitString(result["dirs"].as<std::string>(), ',');
         std::vector<std::string> file_exts = splitString(result["exts"].as<std::string>(), ',');
-        std::string target_encoding = result["target"].as<std::string>();
+        std::string target_encoding = result.count("target") ? result["target"].as<std::string>() : std::string();
         bool backup_enabled = result["backup"].as<bool>();
+        bool ignore_case = result["ignore-case"].as<bool>();
+
+        PipelineOptions pipeline;
+        pipeline.scanners = result["scan-threads"].as<size_t>();
+        pipeline.orderedScan = result["ordered"].as<bool>();
+        pipeline.converters = result["jobs"].as<size_t>();
+        pipeline.readers = result["read-threads"].as<size_t>();
+        pipeline.writers = result["write-threads"].as<size_t>();
+        pipeline.readahead = result["readahead"].as<size_t>();
+        pipeline.batchIo = result["batch-io"].as<bool>();
+        pipeline.writeMode = parseWriteMode(result["write-mode"].as<std::string>());
+        pipeline.syncBatch = result["sync-batch"].as<size_t>();
+        pipeline.dedupCache = parseSize(result["dedup-cache"].as<std::string>());
+        pipeline.stageStats = result.count("stats") != 0;
+        std::unique_ptr<TraceRecorder> trace;
+        if (result.count("trace")) {
+            trace = std::make_unique<TraceRecorder>();
+            pipeline.trace = trace.get();
+        }
+
+        StreamingOptions& streaming = ConverterContext::forCurrentThread().streamingOptions();
+        streaming.threshold = parseSize(result["stream-threshold"].as<std::string>());
+        streaming.chunkSize = parseSize(result["chunk-size"].as<std::string>());
+        streaming.memoryCeiling = parseSize(result["memory-ceiling"].as<std::string>());
+
+        if (audit) {
+            std::cout << "Starting audit (no files are modified)...\n";
+            for (const auto& target_dir : target_dirs) {
+                std::cout << "Scanning directory: " << target_dir << '\n';
+            }
+            std::cout.flush();
+            EncodingCensus census = FileConverter::auditDirectory(target_dirs, file_exts, pipeline, ignore_case, result["audit-depth"].as<size_t>());
+            std::cout << '\n';
+            census.print(std::cout);
+            std::cout.flush();
+            return 0;
+        }
 
         // Call FileConverter class to process files
-        FileConverter::processDirectory(target_dirs, file_exts, target_encoding, backup_enabled);
+        std::unique_ptr<Manifest> manifest;
+        if (result.count("manifest")) {
+            manifest = std::make_unique<Manifest>(result["manifest"].as<std::string>(), target_encoding);
+        }
+        std::unique_ptr<BackupPack> backup_pack;
+        if (result.count("backup-pack")) {
+            backup_pack = std::make_unique<BackupPack>(result["backup-pack"].as<std::string>(), result["compress-backups"].as<bool>());
+        }
+        // Failures and totals are buffered and written in large blocks instead of a flush per file
+        ConsoleObserver console;
+        ConversionSummary summary =
+            FileConverter::processDirectory(target_dirs, file_exts, target_encoding, console, backup_enabled, pipeline, ignore_case, manifest.get(), backup_pack.get());
+        if (manifest) {
+            manifest->save();
+        }
+        if (backup_pack) {
+            backup_pack->close();
+        }
+        if (pipeline.stageStats) {
+            std::string stats_path = result["stats"].as<std::string>();
+            if (stats_path == "-") {
+                summary.stages.writeJson(std::cout);
+            } else {
+                std::ofstream stats_file(stats_path);
+                summary.stages.writeJson(stats_file);
+                stats_file.close();
+                if (!stats_file) {
+                    throw std::runtime_error("Failed to write statistics to " + stats_path);
+                }
+            }
+        }
+        if (trace) {
+            std::string trace_path = result["trace"].as<std::string>();
+            std::ofstream trace_file(trace_path);
+            trace->writeJson(trace_file);
+            trace_file.close();
+            if (!trace_file) {
+                throw std::runtime_error("Failed to write trace to " + trace_path);
+            }
+        }
 
     } catch (const cxxopts::exceptions::exception& e) {
         std::cerr << "Error parsing options: " << e.what() << std::endl;
         return 1;
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error parsing options: " << e.what() << std::endl;
+        return 1;
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Simd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @brief Length of the leading run of 7-bit ASCII bytes.
+ *
+ * Checks 128 bytes per iteration with AVX2, 64 with SSE2 and 8 otherwise, then pins down the exact byte
+ * within the first block that has a high bit set.
+ *
+ * @param data Bytes to scan.
+ * @param size Number of bytes.
+ * @return Offset of the first byte >= 0x80, or size if every byte is ASCII.
+ */
+inline size_t asciiPrefixLength(const char *data, size_t size)
+{
+    size_t i = 0;
+
+#if defined(ENCODING_CONVERTER_AVX2)
+    for (; i + 128 <= size; i += 128)
+    {
+        const __m256i *p = reinterpret_cast<const __m256i *>(data + i);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+            _mm256_or_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+        if (_mm256_movemask_epi8(any) != 0)
+        {
+            break;
+        }
+    }
+    for (; i + 32 <= size; i += 32)
+    {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i))) != 0)
+        {
+            break;
+        }
+    }
+#elif defined(ENCODING_CONVERTER_SSE2)
+    for (; i + 64 <= size; i += 64)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i *>(data + i);
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)), _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        if (_mm_movemask_epi8(any) != 0)
+        {
+            break;
+        }
+    }
+    for (; i + 16 <= size; i += 16)
+    {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))) != 0)
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        if ((word & 0x8080808080808080ull) != 0)
+        {
+            break;
+        }
+    }
+    for (; i < size; ++i)
+    {
+        if (static_cast<unsigned char>(data[i]) >= 0x80)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief Whether every byte is 7-bit ASCII.
+ */
+inline bool isAscii(std::string_view bytes)
+{
+    return asciiPrefixLength(bytes.data(), bytes.size()) == bytes.size();
+}
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #if defined(__linux__) || defined(__APPLE__)
+        #include <sys/xattr.h>
+    #endif
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @enum WriteMode
+ * @brief How converted files replace the originals
+ */
+enum class WriteMode
+{
+    InPlace,  ///< Truncate and rewrite the original; a crash can leave it truncated
+    Atomic,   ///< Write a temporary file and rename it over the original; nothing is flushed to disk
+    Durable   ///< Like Atomic, and the new contents are on disk before the rename, in batches
+};
+
+/**
+ * @class AtomicWriter
+ * @brief Replaces files by writing a temporary file next to each one and renaming it over the original.
+ *
+ * A reader, or the file system after a crash, sees either the old or the new contents of a file, never a
+ * mix or a truncated file. The temporary file gets a unique name, so it never clobbers another file, and takes the
+ * original's permissions and owner before the rename.
+ *
+ * A rename only keeps a file intact if it is a plain file: it would turn a symbolic link into a regular file and
+ * leave its target unconverted, split a hard link off from its other names, and lose an owner the process cannot
+ * set or extended attributes. Files for which canReplaceByRename() is false are therefore rewritten in place,
+ * giving up atomicity for them.
+ *
+ * In Durable mode the data of a temporary file must reach the disk before its rename does, otherwise a crash
+ * can still leave an empty file behind the new name. Flushing every file on its own costs a disk round trip
+ * per file, so files are collected in batches instead: writeback of each temporary file starts as soon as it
+ * is written (sync_file_range on Linux), and when a batch is full all of its files are flushed, which by then
+ * mostly means waiting for writes already under way, and renamed. Each directory that received renames is
+ * flushed once, by flush(). Until a batch commits, its completions have not run and the originals are intact.
+ *
+ * All member functions are thread-safe. Completions run on the thread that commits the batch, outside the
+ * writer's lock.
+ */
+class AtomicWriter
+{
+public:
+    /**
+     * @brief Called once the file has been replaced, or with an error message if it could not be.
+     */
+    using Completion = std::function<void(const std::string &error)>;
+
+    static constexpr size_t kDefaultBatchSize = 64;
+
+    /**
+     * @param mode Atomic or Durable; InPlace truncates and rewrites the files directly.
+     * @param batch_size Files flushed and renamed together in Durable mode.
+     */
+    explicit AtomicWriter(WriteMode mode = WriteMode::Atomic, size_t batch_size = kDefaultBatchSize)
+        : m_mode(mode)
+        , m_batchSize(batch_size ? batch_size : 1)
+    {
+    }
+
+    AtomicWriter(const AtomicWriter &) = delete;
+    AtomicWriter &operator=(const AtomicWriter &) = delete;
+
+    /**
+     * @brief Commits the files still pending, as flush() does.
+     */
+    ~AtomicWriter()
+    {
+        flush();
+    }
+
+    WriteMode mode() const
+    {
+        return m_mode;
+    }
+
+    /**
+     * @brief In Durable mode, call hook before replacing files: once per batch, after its data is flushed and before
+     *        its renames, and before each file rewritten in place. Set it before the first write().
+     *
+     * Used to flush the backups of those files to disk first. If hook returns an error message, the files it was
+     * called for fail with it and stay unchanged.
+     */
+    void setBeforeReplace(std::function<std::string()> hook)
+    {
+        m_beforeReplace = std::move(hook);
+    }
+
+    /**
+     * @brief Replace a file with prefix followed by content.
+     *
+     * The bytes are written before write() returns, so the caller may release them. In Durable mode the
+     * replacement, and the call to done, may wait for the batch to fill or for flush().
+     *
+     * @param path File to replace.
+     * @param prefix Bytes to write first, e.g. a BOM; may be empty.
+     * @param content Bytes to write after the prefix.
+     * @param done Receives the outcome.
+     * @param rename_checked Whether the caller found canReplaceByRename(path) true just before, e.g. before linking a
+     *                       backup to the file, which adds a link; the file is then replaced by rename without a check.
+     */
+    void write(const fs::path &path, std::string_view prefix, std::string_view content, Completion done, bool rename_checked = false)
+    {
+        if (m_mode == WriteMode::InPlace || !(rename_checked || canReplaceByRename(path)))
+        {
+            std::string error = m_mode == WriteMode::Durable && m_beforeReplace ? m_beforeReplace() : std::string();
+            if (!error.empty())
+            {
+                done(error);
+                return;
+            }
+            bool written = writeTo(path, prefix, content) && (m_mode != WriteMode::Durable || syncFile(path));
+            done(written ? std::string() : std::string("Failed to write file"));
+            return;
+        }
+
+        fs::path temp = createTemporary(path);
+        if (temp.empty())
+        {
+            done("Failed to create temporary file");
+            return;
+        }
+        if (!writeTo(temp, prefix, content))
+        {
+            std::error_code ec;
+            fs::remove(temp, ec);
+            done("Failed to write file");
+            return;
+        }
+        if (m_mode == WriteMode::Atomic)
+        {
+            done(replace(temp, path, true) ? std::string() : std::string("Failed to replace file"));
+            return;
+        }
+
+        Pending file{ path, std::move(temp), std::move(done) };
+        startWriteback(file);
+        std::vector<Pending> batch;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(std::move(file));
+            if (m_pending.size() >= m_batchSize)
+            {
+                batch.swap(m_pending);
+            }
+        }
+        commit(batch);
+    }
+
+    /**
+     * @brief Commit the pending batch and flush every directory that received renames since the last flush().
+     */
+    void flush()
+    {
+        std::vector<Pending> batch;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            batch.swap(m_pending);
+        }
+        commit(batch);
+
+        std::set<fs::path> directories;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            directories.swap(m_directories);
+        }
+        for (const fs::path &directory : directories)
+        {
+            syncDirectory(directory);
+        }
+    }
+
+    /**
+     * @brief Record a file replaced outside the writer, so that flush() also flushes its directory.
+     */
+    void replaced(const fs::path &target)
+    {
+        if (m_mode == WriteMode::Durable)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_directories.insert(target.parent_path());
+        }
+    }
+
+    /**
+     * @brief Flush a file's data to disk by path.
+     *
+     * @return false if the file cannot be opened or flushed.
+     */
+    static bool syncFile(const fs::path &path)
+    {
+#ifdef _WIN32
+        HANDLE handle = ::CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        bool synced = ::FlushFileBuffers(handle) != FALSE;
+        ::CloseHandle(handle);
+        return synced;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool synced = syncData(fd);
+        ::close(fd);
+        return synced;
+#endif
+    }
+
+    /**
+     * @brief Flush a directory entry table, making the renames in it durable; a no-op on Windows.
+     */
+    static void syncDirectory(const fs::path &directory)
+    {
+#ifndef _WIN32
+        int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ::fsync(fd);
+            ::close(fd);
+        }
+#else
+        (void)directory;
+#endif
+    }
+
+    /**
+     * @brief Whether renaming a new file over path keeps it intact; true if path does not exist.
+     *
+     * Only a regular file with a single link, an owner the process can give the new file and no extended
+     * attributes qualifies; symbolic links, hard-linked files and the like must be rewritten in place.
+     */
+    static bool canReplaceByRename(const fs::path &path)
+    {
+#ifdef _WIN32
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(path, ec);
+        if (status.type() == fs::file_type::not_found)
+        {
+            return true;
+        }
+        return !ec && status.type() == fs::file_type::regular && fs::hard_link_count(path, ec) == 1 && !ec;
+#else
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0)
+        {
+            return errno == ENOENT;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_nlink != 1 || !canGiveOwner(st.st_uid, st.st_gid))
+        {
+            return false;
+        }
+    #if defined(__linux__)
+        return ::llistxattr(path.c_str(), nullptr, 0) <= 0;
+    #elif defined(__APPLE__)
+        return ::listxattr(path.c_str(), nullptr, 0, XATTR_NOFOLLOW) <= 0;
+    #else
+        return true;
+    #endif
+#endif
+    }
+
+    /**
+     * @brief Replace target's contents with temp's and remove temp.
+     *
+     * If canReplaceByRename(target), temp takes the target's permissions and owner and is renamed over it;
+     * otherwise the target is rewritten in place from temp, through a symbolic link if it is one.
+     *
+     * @param rename_checked Whether the caller found canReplaceByRename(target) true before linking a backup to it; see write().
+     * @return false if the replacement failed; temp is removed in that case as well.
+     */
+    static bool replace(const fs::path &temp, const fs::path &target, bool rename_checked = false)
+    {
+        std::error_code ec;
+        if (!rename_checked && !canReplaceByRename(target))
+        {
+            bool copied = copyContents(temp, target);
+            fs::remove(temp, ec);
+            return copied;
+        }
+        fs::file_status status = fs::status(target, ec);
+        if (!ec)
+        {
+            fs::permissions(temp, status.permissions(), ec);
+        }
+#ifndef _WIN32
+        struct stat st;
+        if (::stat(target.c_str(), &st) == 0 && ::chown(temp.c_str(), st.st_uid, st.st_gid) != 0)
+        {
+            fs::remove(temp, ec);
+            return false;
+        }
+#endif
+#ifdef _WIN32
+        bool renamed = ::MoveFileExW(temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+        bool renamed = ::rename(temp.c_str(), target.c_str()) == 0;
+#endif
+        if (!renamed)
+        {
+            fs::remove(temp, ec);
+        }
+        return renamed;
+    }
+
+    /**
+     * @brief Create an empty temporary file for path, in the same directory so that the rename stays on one file system.
+     *
+     * The file is named after path with a random suffix and created exclusively, so an existing file is never reused;
+     * it starts with the default permissions of a new file, which replace() overrides with the target's if it exists.
+     *
+     * @return The new file, or an empty path if none could be created.
+     */
+    static fs::path createTemporary(const fs::path &path)
+    {
+        for (int attempt = 0; attempt < 16; ++attempt)
+        {
+            fs::path temp = uniquePath(path);
+            bool exists = false;
+            if (createNew(temp, &exists))
+            {
+                return temp;
+            }
+            if (!exists)
+            {
+                return fs::path();
+            }
+        }
+        return fs::path();
+    }
+
+    /**
+     * @brief Create an empty file, failing if anything already exists at path, even a dangling symbolic link.
+     *
+     * @param exists Optional; set to whether the failure was because path exists.
+     * @return false if the file was not created.
+     */
+    static bool createNew(const fs::path &path, bool *exists = nullptr)
+    {
+#ifdef _WIN32
+        HANDLE handle = ::CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            ::CloseHandle(handle);
+            return true;
+        }
+        if (exists)
+        {
+            *exists = ::GetLastError() == ERROR_FILE_EXISTS;
+        }
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd >= 0)
+        {
+            ::close(fd);
+            return true;
+        }
+        if (exists)
+        {
+            *exists = errno == EEXIST;
+        }
+        return false;
+#endif
+    }
+
+    /**
+     * @brief A name next to path that is unlikely to exist, "<path>.<random>.tmp"; nothing is created.
+     *
+     * For callers that create the file themselves and fail if it exists, e.g. with a hard link; otherwise use createTemporary().
+     */
+    static fs::path uniquePath(const fs::path &path)
+    {
+        static std::atomic<uint64_t> counter{ 0 };
+#ifdef _WIN32
+        uint64_t process = ::GetCurrentProcessId();
+#else
+        uint64_t process = static_cast<uint64_t>(::getpid());
+#endif
+        // splitmix64 over the process, the time and a counter, so that names differ across threads and processes
+        uint64_t value = counter.fetch_add(1) + (process << 32) + static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        value ^= value >> 31;
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp", static_cast<unsigned long long>(value));
+        fs::path temp = path;
+        temp += suffix;
+        return temp;
+    }
+
+private:
+    /**
+     * @struct Pending
+     * @brief A written temporary file waiting for its batch to commit
+     */
+    struct Pending
+    {
+        fs::path target;
+        fs::path temp;
+        Completion done;
+        int fd = -1;  ///< POSIX: temporary file kept open from the start of writeback until it is flushed
+    };
+
+    static bool writeTo(const fs::path &path, std::string_view prefix, std::string_view content)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file.write(prefix.data(), static_cast<std::streamsize>(prefix.size()));
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        file.close();
+        return !file.fail();
+    }
+
+    // Helper function: rewrite target in place with temp's bytes, for files a rename would not keep intact
+    static bool copyContents(const fs::path &temp, const fs::path &target)
+    {
+        std::ifstream in(temp, std::ios::binary);
+        std::ofstream out(target, std::ios::binary | std::ios::trunc);
+        if (!in.is_open() || !out.is_open())
+        {
+            return false;
+        }
+        char buffer[64 * 1024];
+        while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+        {
+            out.write(buffer, in.gcount());
+        }
+        out.close();
+        return !in.bad() && !out.fail();
+    }
+
+#ifndef _WIN32
+    // Helper function: whether chown() to uid and gid succeeds, i.e. the process is root, or owns the file and is in its group
+    static bool canGiveOwner(uid_t uid, gid_t gid)
+    {
+        if (::geteuid() == 0)
+        {
+            return true;
+        }
+        if (uid != ::geteuid())
+        {
+            return false;
+        }
+        if (gid == ::getegid())
+        {
+            return true;
+        }
+        int count = ::getgroups(0, nullptr);
+        std::vector<gid_t> groups(count > 0 ? static_cast<size_t>(count) : 0);
+        count = ::getgroups(static_cast<int>(groups.size()), groups.data());
+        return count > 0 && std::find(groups.begin(), groups.begin() + count, gid) != groups.begin() + count;
+    }
+#endif
+
+    // Helper function: start writing the file back without waiting, so that the batch flush finds it mostly done
+    static void startWriteback(Pending &file)
+    {
+#ifndef _WIN32
+        file.fd = ::open(file.temp.c_str(), O_RDONLY | O_CLOEXEC);
+    #if defined(__linux__)
+        if (file.fd >= 0)
+        {
+            ::sync_file_range(file.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+    #endif
+#else
+        (void)file;
+#endif
+    }
+
+#ifndef _WIN32
+    static bool syncData(int fd)
+    {
+    #if defined(__APPLE__)
+        return ::fsync(fd) == 0;
+    #else
+        return ::fdatasync(fd) == 0;
+    #endif
+    }
+#endif
+
+    // Helper function: flush the batch's files, then rename them and report the outcomes
+    void commit(std::vector<Pending> &batch)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+
+        std::vector<std::string> errors(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            Pending &file = batch[i];
+#ifdef _WIN32
+            bool synced = syncFile(file.temp);
+#else
+            bool synced = file.fd >= 0 ? syncData(file.fd) : syncFile(file.temp);
+            if (file.fd >= 0)
+            {
+                ::close(file.fd);
+                file.fd = -1;
+            }
+#endif
+            if (!synced)
+            {
+                std::error_code ec;
+                fs::remove(file.temp, ec);
+                errors[i] = "Failed to write file";
+            }
+        }
+
+        std::string hook_error = m_beforeReplace ? m_beforeReplace() : std::string();
+        std::set<fs::path> directories;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (errors[i].empty() && !hook_error.empty())
+            {
+                std::error_code ec;
+                fs::remove(batch[i].temp, ec);
+                errors[i] = hook_error;
+            }
+            else if (errors[i].empty())
+            {
+                // write() only batches files it checked
+                if (replace(batch[i].temp, batch[i].target, true))
+                {
+                    directories.insert(batch[i].target.parent_path());
+                }
+                else
+                {
+                    errors[i] = "Failed to replace file";
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_directories.insert(directories.begin(), directories.end());
+        }
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            batch[i].done(errors[i]);
+        }
+        batch.clear();
+    }
+
+    WriteMode m_mode;
+    size_t m_batchSize;
+    std::mutex m_mutex;
+    std::vector<Pending> m_pending;      ///< Durable mode: written, not yet flushed and renamed
+    std::set<fs::path> m_directories;    ///< Durable mode: directories with renames not yet flushed
+    std::function<std::string()> m_beforeReplace;  ///< Durable mode: see setBeforeReplace()
+};
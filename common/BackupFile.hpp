@@ -0,0 +1,221 @@
+#pragma once
+
+#include "AtomicWriter.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <system_error>
+#include <unordered_set>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <linux/fs.h>
+        #include <sys/ioctl.h>
+    #elif defined(__APPLE__)
+        #include <sys/clonefile.h>
+    #endif
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @enum BackupMethod
+ * @brief How a backup file was made
+ */
+enum class BackupMethod
+{
+    Reflink,  ///< Copy-on-write clone sharing the original's blocks (FICLONE on Linux, clonefile on macOS)
+    Link,     ///< Hard link to the original's inode; only valid if the original is then replaced by rename
+    Copy      ///< Full copy of the contents
+};
+
+/**
+ * @class BackupFile
+ * @brief Makes the "<file>.bak" backup of a file about to be rewritten, as cheaply as the file system allows.
+ *
+ * A full copy doubles the I/O of a conversion run. Where the file system supports it, the backup is a
+ * reflink, which shares the original's blocks until one of them is written and costs a single metadata
+ * operation. Otherwise, if the caller is going to replace the original by renaming a new file over it, the
+ * backup is a hard link: the original inode lives on under the backup name once the rename has moved the
+ * original name to the new inode. Only if neither works are the contents copied.
+ *
+ * Each backup is made under a fresh unique name and renamed over the old "<file>.bak", which is never opened
+ * for writing: it may be a hard link to the file itself, left behind by an earlier run.
+ *
+ * File systems that refused a reflink are remembered by device, so later backups on them skip the attempt.
+ */
+class BackupFile
+{
+public:
+    /**
+     * @brief Backup path of a file: the file name with ".bak" appended.
+     */
+    static fs::path pathFor(const fs::path &filepath)
+    {
+        fs::path backup_path = filepath;
+        backup_path += ".bak";
+        return backup_path;
+    }
+
+    /**
+     * @brief Create or replace the backup of a file.
+     *
+     * @param filepath File to back up.
+     * @param replaced_by_rename Whether the caller replaces filepath by renaming a new file over it, which makes a
+     *                           hard link a valid backup. Rewriting filepath in place would change a linked backup too.
+     *                           Ignored unless AtomicWriter::canReplaceByRename(filepath), since AtomicWriter rewrites
+     *                           other files in place.
+     * @return The method used.
+     * @throws std::filesystem::filesystem_error if the backup cannot be made.
+     */
+    static BackupMethod create(const fs::path &filepath, bool replaced_by_rename)
+    {
+        fs::path backup_path = pathFor(filepath);
+        if (reflink(filepath, backup_path))
+        {
+            return BackupMethod::Reflink;
+        }
+        if (replaced_by_rename && AtomicWriter::canReplaceByRename(filepath))
+        {
+            fs::path temp = AtomicWriter::uniquePath(backup_path);
+            std::error_code ec;
+            fs::create_hard_link(filepath, temp, ec);
+            if (!ec && moveInto(temp, backup_path))
+            {
+                return BackupMethod::Link;
+            }
+        }
+
+        fs::path temp = AtomicWriter::createTemporary(backup_path);
+        if (temp.empty())
+        {
+            throw fs::filesystem_error("Could not create backup file", backup_path, std::error_code(errno, std::generic_category()));
+        }
+        try
+        {
+            fs::copy_file(filepath, temp, fs::copy_options::overwrite_existing);
+        }
+        catch (const fs::filesystem_error &)
+        {
+            std::error_code ec;
+            fs::remove(temp, ec);
+            throw;
+        }
+        if (!moveInto(temp, backup_path))
+        {
+            throw fs::filesystem_error("Could not replace backup file", backup_path, std::error_code(errno, std::generic_category()));
+        }
+        return BackupMethod::Copy;
+    }
+
+private:
+    // Helper function: rename a new backup over the old one; false if that failed, leaving temp removed
+    static bool moveInto(const fs::path &temp, const fs::path &backup_path)
+    {
+        std::error_code ec;
+        fs::rename(temp, backup_path, ec);
+        // A rename between two links to one file does nothing, e.g. if the old backup already links the file
+        std::error_code ignored;
+        fs::remove(temp, ignored);
+        if (ec)
+        {
+            errno = ec.value();
+        }
+        return !ec;
+    }
+
+    // Helper function: clone the file; false if the file system cannot, leaving no partial backup behind
+    static bool reflink(const fs::path &from, const fs::path &to)
+    {
+#if defined(__linux__) && defined(FICLONE)
+        int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(source, &st) != 0 || !mayReflink(st.st_dev))
+        {
+            ::close(source);
+            return false;
+        }
+        fs::path temp = AtomicWriter::uniquePath(to);
+        int target = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+        bool cloned = false;
+        if (target >= 0)
+        {
+            cloned = ::ioctl(target, FICLONE, source) == 0;
+            if (cloned)
+            {
+                ::fchmod(target, st.st_mode & 07777);
+            }
+            else if (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV || errno == EINVAL)
+            {
+                refuseReflink(st.st_dev);
+            }
+            ::close(target);
+            if (cloned)
+            {
+                cloned = moveInto(temp, to);
+            }
+            else
+            {
+                ::unlink(temp.c_str());
+            }
+        }
+        ::close(source);
+        return cloned;
+#elif defined(__APPLE__)
+        struct stat st;
+        if (::stat(from.c_str(), &st) != 0 || !mayReflink(st.st_dev))
+        {
+            return false;
+        }
+        fs::path temp = AtomicWriter::uniquePath(to);
+        if (::clonefile(from.c_str(), temp.c_str(), 0) == 0)
+        {
+            return moveInto(temp, to);
+        }
+        if (errno == ENOTSUP || errno == EXDEV)
+        {
+            refuseReflink(st.st_dev);
+        }
+        return false;
+#else
+        (void)from;
+        (void)to;
+        return false;
+#endif
+    }
+
+#ifndef _WIN32
+    static std::mutex &devicesMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::unordered_set<uint64_t> &devicesWithoutReflink()
+    {
+        static std::unordered_set<uint64_t> devices;
+        return devices;
+    }
+
+    static bool mayReflink(dev_t device)
+    {
+        std::lock_guard<std::mutex> lock(devicesMutex());
+        return devicesWithoutReflink().count(static_cast<uint64_t>(device)) == 0;
+    }
+
+    static void refuseReflink(dev_t device)
+    {
+        std::lock_guard<std::mutex> lock(devicesMutex());
+        devicesWithoutReflink().insert(static_cast<uint64_t>(device));
+    }
+#endif
+};
@@ -0,0 +1,615 @@
+#pragma once
+
+#include "AtomicWriter.hpp"
+#include "ContentHash.hpp"
+#include "MappedFile.hpp"
+#include "ResultSink.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @struct BackupPackEntry
+ * @brief One file stored in a backup pack
+ */
+struct BackupPackEntry
+{
+    fs::path path;            ///< Path the file was backed up from
+    uint64_t offset = 0;      ///< Position of the stored bytes in the pack
+    uint64_t storedSize = 0;  ///< Bytes in the pack
+    uint64_t size = 0;        ///< Bytes of the original file
+    uint32_t permissions = 0; ///< fs::perms of the original file
+    bool compressed = false;  ///< Stored as a zlib stream
+    bool shared = false;      ///< The stored bytes are those of an earlier entry with the same contents
+    uint64_t checksum = 0;    ///< XXH64 of the stored bytes
+};
+
+/**
+ * @struct RestoredFile
+ * @brief Outcome of restoring one entry of a backup pack
+ */
+struct RestoredFile
+{
+    fs::path path;
+    std::string error;  ///< Empty on success
+};
+
+/**
+ * @class BackupPack
+ * @brief Appends the originals of rewritten files to a single pack file, as an alternative to ".bak" files.
+ *
+ * A ".bak" file per converted file doubles the number of inodes in the tree, which slows every later
+ * directory walk. A pack holds all the backups of a run in one file with an index at the end, and
+ * BackupPackReader restores them. With compression (only when built with HAVE_ZLIB), each entry is a
+ * separate zlib stream, compressed by the thread that adds it, outside the pack's lock; an entry that
+ * does not shrink, or is larger than 64 MiB, is stored as is. Entries added with a ContentKey are stored
+ * once per distinct content: later copies only add an index record pointing at the first one's bytes.
+ *
+ * File layout, in native byte order:
+ * - Header
+ * - for each entry, in the order they were added: EntryHeader, the path bytes (fs::path::native()), then the
+ *   stored bytes, unless the entry shares those of an earlier entry
+ * - Trailer, written by close()
+ *
+ * Every entry describes itself and is flushed to the operating system before add() returns, so before the
+ * caller rewrites the file; sync() also flushes the entries to disk. A pack that was never closed, e.g. after
+ * a crash, has no trailer: BackupPackReader then recovers every entry up to the first one that is incomplete
+ * or fails its checksum. An existing pack is never overwritten, so a second run cannot destroy the backups
+ * of the first.
+ */
+class BackupPack
+{
+public:
+    /**
+     * @brief Create the pack file.
+     *
+     * @param file Pack file to write; must not exist yet.
+     * @param compress Whether entries are compressed; ignored without HAVE_ZLIB.
+     * @throws std::runtime_error if the file exists or cannot be created.
+     */
+    explicit BackupPack(const fs::path &file, bool compress = false)
+        : m_file(file)
+#ifdef HAVE_ZLIB
+        , m_compress(compress)
+#endif
+    {
+        (void)compress;
+        bool exists = false;
+        if (!AtomicWriter::createNew(file, &exists))
+        {
+            throw std::runtime_error((exists ? "Backup pack already exists: " : "Could not create backup pack: ") + file.string());
+        }
+        m_out.open(file, std::ios::binary | std::ios::trunc);
+        if (!m_out.is_open())
+        {
+            throw std::runtime_error("Could not create backup pack: " + file.string());
+        }
+        Header header;
+        m_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_out.flush();
+        m_offset = sizeof(header);
+    }
+
+    BackupPack(const BackupPack &) = delete;
+    BackupPack &operator=(const BackupPack &) = delete;
+
+    ~BackupPack()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /**
+     * @brief Whether entries are compressed.
+     */
+    bool compressed() const
+    {
+        return m_compress;
+    }
+
+    /**
+     * @brief Append the current contents of a file.
+     *
+     * @throws std::runtime_error if the file cannot be read or the pack cannot be written.
+     */
+    void add(const fs::path &file)
+    {
+        MappedFile input(file);
+        add(file, input.bytes());
+    }
+
+    /**
+     * @brief Append a file's contents held in memory, and flush the entry to the operating system. Thread-safe.
+     *
+     * @param file Path the contents were read from; restored to this path.
+     * @param bytes Contents of the file.
+     * @param content Optional key of bytes; contents already stored under the same key are not stored again.
+     * @throws std::runtime_error if the pack cannot be written.
+     */
+    void add(const fs::path &file, std::string_view bytes, const ContentKey *content = nullptr)
+    {
+        BackupPackEntry entry;
+        entry.path = file;
+        entry.size = bytes.size();
+        std::error_code ec;
+        entry.permissions = static_cast<uint32_t>(fs::status(file, ec).permissions());
+
+        if (content && addStored(entry, *content))
+        {
+            return;
+        }
+
+        std::string deflated;
+        if (m_compress && bytes.size() <= kMaxCompressedEntry && deflateBytes(bytes, deflated) && deflated.size() < bytes.size())
+        {
+            entry.compressed = true;
+            bytes = deflated;
+        }
+        entry.storedSize = bytes.size();
+        entry.checksum = ContentKey::xxh64(bytes.data(), bytes.size());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            throw std::runtime_error("Backup pack is closed");
+        }
+        // Another thread may have stored the same contents while these were compressed
+        if (content)
+        {
+            auto stored = m_stored.find(*content);
+            if (stored != m_stored.end())
+            {
+                append(sharing(std::move(entry), stored->second), std::string_view());
+                return;
+            }
+        }
+        append(std::move(entry), bytes);
+        ++m_storedCount;
+        if (content)
+        {
+            m_stored.emplace(*content, m_entries.size() - 1);
+        }
+    }
+
+    /**
+     * @brief Number of entries added so far.
+     */
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    /**
+     * @brief Number of entries whose bytes are in the pack; the others share them.
+     */
+    size_t storedCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_storedCount;
+    }
+
+    /**
+     * @brief Flush the entries added so far to disk, e.g. before files they back up are replaced durably. Thread-safe.
+     *
+     * @return false if the pack could not be flushed.
+     */
+    bool sync()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed)
+            {
+                return true;
+            }
+            m_out.flush();
+            if (!m_out)
+            {
+                return false;
+            }
+        }
+        return AtomicWriter::syncFile(m_file);
+    }
+
+    /**
+     * @brief Write the trailer, flush the pack to disk and close it; later add() calls throw. Called by the destructor.
+     *
+     * @throws std::runtime_error if the trailer cannot be written.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            return;
+        }
+        m_closed = true;
+
+        Trailer trailer;
+        trailer.entriesEnd = m_offset;
+        trailer.entryCount = m_entries.size();
+        m_out.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+        m_out.close();
+        if (!m_out || !AtomicWriter::syncFile(m_file))
+        {
+            throw std::runtime_error("Could not write backup pack: " + m_file.string());
+        }
+    }
+
+private:
+    friend class BackupPackReader;
+
+    static constexpr uint32_t kVersion = 2;
+    static constexpr size_t kMaxCompressedEntry = 64 * 1024 * 1024;  ///< Larger files are stored as is, to bound memory
+    static constexpr uint32_t kMethodStored = 0;
+    static constexpr uint32_t kMethodZlib = 1;
+
+    struct Header
+    {
+        char magic[4] = { 'E', 'C', 'B', 'P' };
+        uint32_t version = kVersion;
+        uint32_t pathUnit = sizeof(fs::path::value_type);  ///< 1 for POSIX paths, 2 for Windows paths
+        uint32_t reserved = 0;
+    };
+
+    struct EntryHeader
+    {
+        char magic[4] = { 'E', 'C', 'B', 'E' };
+        uint32_t pathBytes = 0;
+        uint64_t offset = 0;      ///< Stored bytes: right after the path, or those of an earlier entry
+        uint64_t storedSize = 0;
+        uint64_t size = 0;
+        uint64_t checksum = 0;    ///< XXH64 of the stored bytes, mixed with that of the path bytes
+        uint32_t permissions = 0;
+        uint32_t method = kMethodStored;
+    };
+
+    struct Trailer
+    {
+        uint64_t entriesEnd = 0;  ///< Offset of the trailer
+        uint64_t entryCount = 0;
+        char magic[4] = { 'E', 'C', 'B', 'T' };
+        uint32_t version = kVersion;
+    };
+
+    static uint64_t entryChecksum(const fs::path::string_type &native, uint64_t bytes_checksum)
+    {
+        return ContentKey::xxh64(native.data(), native.size() * sizeof(fs::path::value_type), bytes_checksum);
+    }
+
+    // Helper function: write an entry's header, path and stored bytes, if it has its own, and flush them; call locked
+    void append(BackupPackEntry entry, std::string_view bytes)
+    {
+        const fs::path::string_type &native = entry.path.native();
+        EntryHeader header;
+        header.pathBytes = static_cast<uint32_t>(native.size() * sizeof(fs::path::value_type));
+        uint64_t bytes_offset = m_offset + sizeof(header) + header.pathBytes;
+        if (!entry.shared)
+        {
+            entry.offset = bytes_offset;
+        }
+        header.offset = entry.offset;
+        header.storedSize = entry.storedSize;
+        header.size = entry.size;
+        header.checksum = entryChecksum(native, entry.checksum);
+        header.permissions = entry.permissions;
+        header.method = entry.compressed ? kMethodZlib : kMethodStored;
+        m_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_out.write(reinterpret_cast<const char *>(native.data()), header.pathBytes);
+        m_out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        m_out.flush();
+        if (!m_out)
+        {
+            throw std::runtime_error("Could not write backup pack: " + m_file.string());
+        }
+        m_offset = bytes_offset + bytes.size();
+        m_entries.push_back(std::move(entry));
+    }
+
+    // Helper function: add an entry sharing the bytes of the contents stored under the key; false if there are none
+    bool addStored(BackupPackEntry &entry, const ContentKey &content)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            throw std::runtime_error("Backup pack is closed");
+        }
+        auto stored = m_stored.find(content);
+        if (stored == m_stored.end())
+        {
+            return false;
+        }
+        append(sharing(std::move(entry), stored->second), std::string_view());
+        return true;
+    }
+
+    BackupPackEntry sharing(BackupPackEntry entry, size_t index) const
+    {
+        const BackupPackEntry &original = m_entries[index];
+        entry.offset = original.offset;
+        entry.storedSize = original.storedSize;
+        entry.compressed = original.compressed;
+        entry.checksum = original.checksum;
+        entry.shared = true;
+        return entry;
+    }
+
+    // Helper function: compress into one zlib stream; false if compression is unavailable or fails
+    static bool deflateBytes(std::string_view bytes, std::string &out)
+    {
+#ifdef HAVE_ZLIB
+        z_stream stream{};
+        if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
+        {
+            return false;
+        }
+        out.resize(deflateBound(&stream, static_cast<uLong>(bytes.size())));
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(bytes.data()));
+        stream.avail_in = static_cast<uInt>(bytes.size());
+        stream.next_out = reinterpret_cast<Bytef *>(out.data());
+        stream.avail_out = static_cast<uInt>(out.size());
+        int status = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return status == Z_STREAM_END;
+#else
+        (void)bytes;
+        (void)out;
+        return false;
+#endif
+    }
+
+    fs::path m_file;
+#ifdef HAVE_ZLIB
+    bool m_compress = false;
+#else
+    static constexpr bool m_compress = false;
+#endif
+    mutable std::mutex m_mutex;
+    std::ofstream m_out;
+    uint64_t m_offset = 0;
+    bool m_closed = false;
+    std::vector<BackupPackEntry> m_entries;
+    std::unordered_map<ContentKey, size_t, ContentKeyHash> m_stored;  ///< Content to the index of the entry holding its bytes
+    size_t m_storedCount = 0;
+};
+
+/**
+ * @class BackupPackReader
+ * @brief Reads the entries of a backup pack and restores them.
+ *
+ * The pack is memory-mapped, so entries are extracted straight from the page cache, and restore() extracts
+ * them on a pool of threads. A pack that was not closed is recovered: its entries are read up to the first
+ * one that is incomplete or fails its checksum, and complete() is false.
+ */
+class BackupPackReader
+{
+public:
+    /**
+     * @brief Open a pack and read its entry headers.
+     *
+     * @throws std::runtime_error if the file cannot be read or is not a backup pack, or a closed pack is corrupt.
+     */
+    explicit BackupPackReader(const fs::path &file)
+        : m_pack(file, 0)
+    {
+        if (!parse())
+        {
+            throw std::runtime_error("Not a valid backup pack: " + file.string());
+        }
+    }
+
+    const std::vector<BackupPackEntry> &entries() const
+    {
+        return m_entries;
+    }
+
+    /**
+     * @brief Whether the pack was closed; if not, entries() holds the entries recovered from it.
+     */
+    bool complete() const
+    {
+        return m_complete;
+    }
+
+    /**
+     * @brief Decompress one entry into out.
+     *
+     * @throws std::runtime_error if the entry is corrupt or compressed and zlib support is not built in.
+     */
+    void extract(const BackupPackEntry &entry, std::string &out) const
+    {
+        std::string_view stored = m_pack.bytes().substr(entry.offset, entry.storedSize);
+        if (!entry.compressed)
+        {
+            out.assign(stored.data(), stored.size());
+            return;
+        }
+#ifdef HAVE_ZLIB
+        out.resize(entry.size);
+        uLongf size = static_cast<uLongf>(entry.size);
+        if (uncompress(reinterpret_cast<Bytef *>(out.data()), &size, reinterpret_cast<const Bytef *>(stored.data()), static_cast<uLong>(stored.size())) != Z_OK ||
+            size != entry.size)
+        {
+            throw std::runtime_error("Corrupt backup entry: " + entry.path.string());
+        }
+#else
+        throw std::runtime_error("Backup entry is compressed, and zlib support is not built in: " + entry.path.string());
+#endif
+    }
+
+    /**
+     * @brief Restore every entry, each by writing a temporary file and renaming it over the target.
+     *
+     * @param threads Number of threads extracting entries; 0 uses ThreadPool::defaultWorkerCount().
+     * @param sink Receives one RestoredFile per entry, in completion order; flushed before restore() returns.
+     * @param destination If not empty, entries are restored under this directory instead of to their original
+     *                    paths, with their original path (minus its root) appended.
+     */
+    void restore(size_t threads, ResultSink<RestoredFile> &sink, const fs::path &destination = fs::path()) const
+    {
+        ThreadPool pool(std::min(threads ? threads : ThreadPool::defaultWorkerCount(), std::max<size_t>(m_entries.size(), 1)));
+        AtomicWriter writer(WriteMode::Atomic);
+        for (const BackupPackEntry &entry : m_entries)
+        {
+            pool.submit([this, &entry, &writer, &sink, &destination] {
+                fs::path target = destination.empty() ? entry.path : destination / entry.path.relative_path();
+                std::string bytes;
+                try
+                {
+                    extract(entry, bytes);
+                    if (!destination.empty())
+                    {
+                        fs::create_directories(target.parent_path());
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    sink.deliver(RestoredFile{ target, e.what() });
+                    return;
+                }
+                writer.write(target, std::string_view(), bytes, [&](const std::string &error) {
+                    if (error.empty())
+                    {
+                        std::error_code ec;
+                        fs::permissions(target, static_cast<fs::perms>(entry.permissions), ec);
+                    }
+                    sink.deliver(RestoredFile{ target, error });
+                });
+            });
+        }
+        pool.wait();
+        sink.flush();
+    }
+
+private:
+    // Helper function: read the entries, up to the trailer if the pack was closed; false if it is not a backup pack
+    // or a closed pack is corrupt
+    bool parse()
+    {
+        std::string_view bytes = m_pack.bytes();
+        BackupPack::Header header;
+        BackupPack::Header expected_header;
+        if (bytes.size() < sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, expected_header.magic, sizeof(header.magic)) != 0 || header.version != BackupPack::kVersion ||
+            header.pathUnit != sizeof(fs::path::value_type))
+        {
+            return false;
+        }
+
+        BackupPack::Trailer trailer;
+        BackupPack::Trailer expected_trailer;
+        uint64_t end = bytes.size();
+        if (bytes.size() >= sizeof(header) + sizeof(trailer))
+        {
+            std::memcpy(&trailer, bytes.data() + bytes.size() - sizeof(trailer), sizeof(trailer));
+            m_complete = std::memcmp(trailer.magic, expected_trailer.magic, sizeof(trailer.magic)) == 0 &&
+                         trailer.version == BackupPack::kVersion && trailer.entriesEnd == bytes.size() - sizeof(trailer);
+            if (m_complete)
+            {
+                end = trailer.entriesEnd;
+            }
+        }
+
+        uint64_t position = sizeof(header);
+        while (position < end)
+        {
+            BackupPackEntry entry;
+            uint64_t next = 0;
+            if (!parseEntry(position, end, entry, next))
+            {
+                // Without a trailer, the entries after the last intact one were cut off by a crash
+                return !m_complete;
+            }
+            m_entries.push_back(std::move(entry));
+            position = next;
+        }
+        return !m_complete || m_entries.size() == trailer.entryCount;
+    }
+
+    // Helper function: read and verify the entry at position; false if it is incomplete, out of range or corrupt
+    bool parseEntry(uint64_t position, uint64_t end, BackupPackEntry &entry, uint64_t &next) const
+    {
+        std::string_view bytes = m_pack.bytes();
+        BackupPack::EntryHeader record;
+        BackupPack::EntryHeader expected;
+        if (end - position < sizeof(record))
+        {
+            return false;
+        }
+        std::memcpy(&record, bytes.data() + position, sizeof(record));
+        uint64_t path_offset = position + sizeof(record);
+        if (std::memcmp(record.magic, expected.magic, sizeof(record.magic)) != 0 || end - path_offset < record.pathBytes ||
+            record.pathBytes % sizeof(fs::path::value_type) != 0 || record.method > BackupPack::kMethodZlib ||
+            (record.method == BackupPack::kMethodStored && record.size != record.storedSize))
+        {
+            return false;
+        }
+        uint64_t bytes_offset = path_offset + record.pathBytes;
+        if (record.offset == bytes_offset)
+        {
+            if (end - bytes_offset < record.storedSize)
+            {
+                return false;
+            }
+            next = bytes_offset + record.storedSize;
+        }
+        else
+        {
+            // Shares the bytes of an earlier entry
+            if (record.offset < sizeof(BackupPack::Header) || record.offset > position || position - record.offset < record.storedSize)
+            {
+                return false;
+            }
+            next = bytes_offset;
+            entry.shared = true;
+        }
+
+        fs::path::string_type native(record.pathBytes / sizeof(fs::path::value_type), fs::path::value_type());
+        std::memcpy(native.data(), bytes.data() + path_offset, record.pathBytes);
+        entry.checksum = ContentKey::xxh64(bytes.data() + record.offset, record.storedSize);
+        if (BackupPack::entryChecksum(native, entry.checksum) != record.checksum)
+        {
+            return false;
+        }
+        entry.path = fs::path(std::move(native));
+        entry.offset = record.offset;
+        entry.storedSize = record.storedSize;
+        entry.size = record.size;
+        entry.permissions = record.permissions;
+        entry.compressed = record.method == BackupPack::kMethodZlib;
+        return true;
+    }
+
+    MappedFile m_pack;
+    std::vector<BackupPackEntry> m_entries;
+    bool m_complete = false;
+};
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#if defined(HAVE_IO_URING) && defined(__linux__)
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @struct BatchRead
+ * @brief Outcome of reading one file through BatchIo::read
+ */
+struct BatchRead
+{
+    std::unique_ptr<char[]> data;  ///< The file's bytes; only if complete
+    size_t size = 0;
+    bool complete = false;  ///< Whether the batch read the whole file; otherwise the caller reads it synchronously
+};
+
+/**
+ * @struct BatchWrite
+ * @brief One file to replace through BatchIo::write: prefix followed by content
+ */
+struct BatchWrite
+{
+    fs::path path;
+    std::string_view prefix;
+    std::string_view content;
+};
+
+/**
+ * @class BatchIo
+ * @brief Reads and writes whole small files in batches through io_uring, several system calls at a time.
+ *
+ * For a tree of small files the open, read and close calls cost more than the bytes moved. Here each step is
+ * queued for a whole batch of files and submitted with a single io_uring_enter(): one call opens every file of
+ * the batch, one reads them, one closes them, instead of one call per file and step. Reads go into buffers
+ * registered with the ring once (slot_size bytes per file of a batch), so the kernel does not map the pages
+ * again for every read; the bytes are then copied into an exactly sized buffer that travels with the file.
+ * Writes are a writev() of the prefix and content straight from the caller's memory.
+ *
+ * Anything the batch does not handle is left to the caller's synchronous path: files of slot_size bytes or
+ * more, files the batch failed to open, read or write (the synchronous path then reports the real error), and
+ * every file when io_uring is unavailable. That is the case unless built with HAVE_IO_URING on Linux, and at
+ * run time on kernels older than 5.6 or where io_uring is disabled, e.g. by seccomp in a container.
+ *
+ * An instance is not thread-safe; give each thread its own.
+ */
+class BatchIo
+{
+public:
+    static constexpr size_t kDefaultBatchSize = 32;
+    static constexpr size_t kDefaultSlotSize = 64 * 1024;
+
+    /**
+     * @param batch_size Files submitted together at most.
+     * @param slot_size Read buffer per file; files at least this large are left to the caller.
+     */
+    explicit BatchIo(size_t batch_size = kDefaultBatchSize, size_t slot_size = kDefaultSlotSize)
+        : m_batchSize(std::min<size_t>(batch_size ? batch_size : 1, 4096))
+        , m_slotSize(slot_size ? slot_size : 1)
+    {
+#if defined(HAVE_IO_URING) && defined(__linux__)
+        setup();
+#endif
+    }
+
+    BatchIo(const BatchIo &) = delete;
+    BatchIo &operator=(const BatchIo &) = delete;
+
+    ~BatchIo()
+    {
+#if defined(HAVE_IO_URING) && defined(__linux__)
+        teardown();
+#endif
+    }
+
+    /**
+     * @brief Whether the ring is set up; if not, read() and write() hand every file back to the caller.
+     */
+    bool available() const
+    {
+        return m_ring >= 0;
+    }
+
+    size_t batchSize() const
+    {
+        return m_batchSize;
+    }
+
+    /**
+     * @brief Read whole files, batchSize() at a time.
+     *
+     * @param paths Files to read.
+     * @param results Receives one entry per path; entries not complete must be read by the caller.
+     */
+    void read(const std::vector<fs::path> &paths, std::vector<BatchRead> &results)
+    {
+        results.clear();
+        results.resize(paths.size());
+#if defined(HAVE_IO_URING) && defined(__linux__)
+        for (size_t first = 0; first < paths.size() && available(); first += m_batchSize)
+        {
+            readBatch(&paths[first], std::min(m_batchSize, paths.size() - first), &results[first]);
+        }
+#endif
+    }
+
+    /**
+     * @brief Create or truncate files and write them, batchSize() at a time.
+     *
+     * @param files Files to write; the bytes must stay valid until write() returns.
+     * @param written Receives one flag per file; files not written must be written by the caller.
+     */
+    void write(const std::vector<BatchWrite> &files, std::vector<bool> &written)
+    {
+        written.assign(files.size(), false);
+#if defined(HAVE_IO_URING) && defined(__linux__)
+        for (size_t first = 0; first < files.size() && available(); first += m_batchSize)
+        {
+            size_t count = std::min(m_batchSize, files.size() - first);
+            std::vector<bool> done;
+            writeBatch(&files[first], count, done);
+            for (size_t i = 0; i < count; ++i)
+            {
+                written[first + i] = done[i];
+            }
+        }
+#endif
+    }
+
+private:
+    size_t m_batchSize;
+    size_t m_slotSize;
+    int m_ring = -1;
+
+#if defined(HAVE_IO_URING) && defined(__linux__)
+    static int enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    static int registerWith(int ring, unsigned opcode, const void *arg, unsigned count)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, ring, opcode, arg, count));
+    }
+
+    // Helper function: map the rings and register the read buffers; leaves m_ring at -1 if io_uring cannot be used
+    void setup()
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int ring = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(m_batchSize), &params));
+        if (ring < 0)
+        {
+            return;
+        }
+        m_ring = ring;
+        if (!supportsOperations())
+        {
+            teardown();
+            return;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+        {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED)
+        {
+            m_sqRing = nullptr;
+            teardown();
+            return;
+        }
+        if (single_mmap)
+        {
+            m_cqRing = m_sqRing;
+        }
+        else
+        {
+            m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED)
+            {
+                m_cqRing = nullptr;
+                teardown();
+                return;
+            }
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            teardown();
+            return;
+        }
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+        char *sq = static_cast<char *>(m_sqRing);
+        char *cq = static_cast<char *>(m_cqRing);
+        m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // Registration pins the buffers and counts against RLIMIT_MEMLOCK; without it reads use plain IORING_OP_READ
+        m_slots.reset(new char[m_batchSize * m_slotSize]);
+        std::vector<iovec> buffers(m_batchSize);
+        for (size_t i = 0; i < m_batchSize; ++i)
+        {
+            buffers[i].iov_base = m_slots.get() + i * m_slotSize;
+            buffers[i].iov_len = m_slotSize;
+        }
+        m_registered = registerWith(ring, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(m_batchSize)) == 0;
+    }
+
+    // Helper function: whether the kernel knows every operation used here (all of them arrived in 5.6, with the probe)
+    bool supportsOperations() const
+    {
+        const unsigned needed[] = { IORING_OP_OPENAT, IORING_OP_READ_FIXED, IORING_OP_READ, IORING_OP_WRITEV, IORING_OP_CLOSE };
+        const unsigned op_count = 64;
+        std::vector<char> storage(sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+        if (registerWith(m_ring, IORING_REGISTER_PROBE, probe, op_count) < 0)
+        {
+            return false;
+        }
+        for (unsigned op : needed)
+        {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void teardown()
+    {
+        if (m_sqes)
+        {
+            ::munmap(m_sqes, m_sqesSize);
+            m_sqes = nullptr;
+        }
+        if (m_cqRing && m_cqRing != m_sqRing)
+        {
+            ::munmap(m_cqRing, m_cqRingSize);
+        }
+        m_cqRing = nullptr;
+        if (m_sqRing)
+        {
+            ::munmap(m_sqRing, m_sqRingSize);
+            m_sqRing = nullptr;
+        }
+        if (m_ring >= 0)
+        {
+            ::close(m_ring);
+            m_ring = -1;
+        }
+    }
+
+    // Helper function: next free submission entry, cleared; user_data identifies the file within the batch
+    io_uring_sqe *queue(uint8_t opcode, int fd, size_t user_data)
+    {
+        unsigned index = m_sqQueued & m_sqMask;
+        io_uring_sqe *sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = user_data;
+        m_sqArray[index] = index;
+        ++m_sqQueued;
+        ++m_sqCount;
+        return sqe;
+    }
+
+    // Helper function: submit the queued entries and store each one's result at results[user_data]
+    bool submit(std::vector<int> &results)
+    {
+        unsigned count = m_sqCount;
+        m_sqCount = 0;
+        if (count == 0)
+        {
+            return true;
+        }
+        __atomic_store_n(m_sqTail, m_sqQueued, __ATOMIC_RELEASE);
+        unsigned submitted = 0;
+        while (submitted < count)
+        {
+            int n = enter(m_ring, count - submitted, count - submitted, IORING_ENTER_GETEVENTS);
+            if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                // The ring is unusable; whatever is left goes the synchronous way from now on
+                teardown();
+                return false;
+            }
+            submitted += n > 0 ? static_cast<unsigned>(n) : 0;
+        }
+
+        unsigned completed = 0;
+        while (completed < count)
+        {
+            unsigned head = *m_cqHead;
+            unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail)
+            {
+                enter(m_ring, 0, 1, IORING_ENTER_GETEVENTS);
+                continue;
+            }
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+                results[static_cast<size_t>(cqe.user_data)] = cqe.res;
+                ++completed;
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    // Helper function: open, read and close up to m_batchSize files with three submissions
+    void readBatch(const fs::path *paths, size_t count, BatchRead *results)
+    {
+        std::vector<int> fds(count, -1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            io_uring_sqe *sqe = queue(IORING_OP_OPENAT, AT_FDCWD, i);
+            sqe->addr = reinterpret_cast<uintptr_t>(paths[i].c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        if (!submit(fds))
+        {
+            return;
+        }
+
+        std::vector<int> got(count, -1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                io_uring_sqe *sqe = queue(m_registered ? IORING_OP_READ_FIXED : IORING_OP_READ, fds[i], i);
+                sqe->addr = reinterpret_cast<uintptr_t>(m_slots.get() + i * m_slotSize);
+                sqe->len = static_cast<uint32_t>(m_slotSize);
+                sqe->buf_index = static_cast<uint16_t>(i);
+            }
+        }
+        bool submitted = submit(got);
+        closeAll(fds, submitted);
+        if (!submitted)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // A full slot may mean the file goes on; such files are left to the caller
+            if (fds[i] >= 0 && got[i] >= 0 && static_cast<size_t>(got[i]) < m_slotSize)
+            {
+                size_t size = static_cast<size_t>(got[i]);
+                results[i].data.reset(new char[size ? size : 1]);
+                std::memcpy(results[i].data.get(), m_slots.get() + i * m_slotSize, size);
+                results[i].size = size;
+                results[i].complete = true;
+            }
+        }
+    }
+
+    // Helper function: open, write and close up to m_batchSize files with three submissions
+    void writeBatch(const BatchWrite *files, size_t count, std::vector<bool> &done)
+    {
+        done.assign(count, false);
+        std::vector<int> fds(count, -1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            io_uring_sqe *sqe = queue(IORING_OP_OPENAT, AT_FDCWD, i);
+            sqe->addr = reinterpret_cast<uintptr_t>(files[i].path.c_str());
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            sqe->len = 0666;
+        }
+        if (!submit(fds))
+        {
+            return;
+        }
+
+        std::vector<iovec> vectors(count * 2);
+        std::vector<int> wrote(count, -1);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                vectors[i * 2].iov_base = const_cast<char *>(files[i].prefix.data());
+                vectors[i * 2].iov_len = files[i].prefix.size();
+                vectors[i * 2 + 1].iov_base = const_cast<char *>(files[i].content.data());
+                vectors[i * 2 + 1].iov_len = files[i].content.size();
+                io_uring_sqe *sqe = queue(IORING_OP_WRITEV, fds[i], i);
+                sqe->addr = reinterpret_cast<uintptr_t>(&vectors[i * 2]);
+                sqe->len = 2;
+            }
+        }
+        bool submitted = submit(wrote);
+        for (size_t i = 0; i < count && submitted; ++i)
+        {
+            // A short write is finished synchronously, while the file is still open
+            done[i] = fds[i] >= 0 && wrote[i] >= 0 &&
+                      writeRest(fds[i], files[i], static_cast<size_t>(wrote[i]));
+        }
+
+        std::vector<int> closed = closeAll(fds, submitted);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (closed[i] < 0)
+            {
+                done[i] = false;
+            }
+        }
+    }
+
+    // Helper function: close the open descriptors, in one submission while the ring works; returns each close() result
+    std::vector<int> closeAll(const std::vector<int> &fds, bool use_ring)
+    {
+        std::vector<int> closed(fds.size(), 0);
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                if (use_ring)
+                {
+                    queue(IORING_OP_CLOSE, fds[i], i);
+                }
+                else
+                {
+                    closed[i] = ::close(fds[i]);
+                }
+            }
+        }
+        if (use_ring)
+        {
+            submit(closed);
+        }
+        return closed;
+    }
+
+    static bool writeRest(int fd, const BatchWrite &file, size_t written)
+    {
+        std::string_view parts[2] = { file.prefix, file.content };
+        size_t offset = 0;
+        for (std::string_view part : parts)
+        {
+            size_t skip = std::min(written, part.size());
+            written -= skip;
+            part.remove_prefix(skip);
+            offset += skip;
+            while (!part.empty())
+            {
+                ssize_t n = ::pwrite(fd, part.data(), part.size(), static_cast<off_t>(offset));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                part.remove_prefix(static_cast<size_t>(n));
+                offset += static_cast<size_t>(n);
+            }
+        }
+        return true;
+    }
+
+    void *m_sqRing = nullptr;
+    void *m_cqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    unsigned *m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned *m_sqArray = nullptr;
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+    unsigned m_sqQueued = 0;  ///< Submission tail including entries queued but not yet published
+    unsigned m_sqCount = 0;   ///< Entries queued since the last submit()
+    std::unique_ptr<char[]> m_slots;  ///< m_batchSize read buffers of m_slotSize bytes
+    bool m_registered = false;        ///< Whether m_slots is registered with the ring, for IORING_OP_READ_FIXED
+#endif
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/**
+ * @class BoundedQueue
+ * @brief Fixed-capacity lock-free multi-producer multi-consumer queue.
+ *
+ * This is Dmitry Vyukov's bounded MPMC queue: a ring of cells, each carrying a sequence number that tells
+ * producers and consumers whose turn it is, so a push or pop is one compare-and-swap on the shared
+ * position plus one store to the cell. tryPush() and tryPop() never block. push() and pop() spin and yield
+ * for a bounded number of attempts, which covers the short gaps between items of a busy pipeline stage, and
+ * then park on a condition variable until a pop makes room, a push brings an item, or close() is called.
+ * A successful push or pop, including tryPush() and tryPop(), only takes the lock to notify when a thread is
+ * parked on the other side, so the queue stays lock-free while it is busy. close() ends the stream: pushes fail, and pops drain what is left,
+ * then fail.
+ *
+ * T must be default constructible and movable.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+     * @param capacity Maximum number of queued items, rounded up to a power of two (at least 2).
+     */
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    /**
+     * @brief Number of items queued; may be stale by the time it returns, so for monitoring only.
+     */
+    size_t approximateSize() const
+    {
+        size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+        size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? std::min(enqueued - dequeued, capacity()) : 0;
+    }
+
+    /**
+     * @brief Append an item if there is room; value is left untouched when the queue is full.
+     */
+    bool tryPush(T &value)
+    {
+        size_t position = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    wake(m_popWaiters, m_notEmpty);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Remove the oldest item if there is one.
+     */
+    bool tryPop(T &value)
+    {
+        size_t position = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(position, position + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    wake(m_pushWaiters, m_notFull);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Append an item, waiting for room.
+     *
+     * @return false if the queue was closed; value is left untouched in that case.
+     */
+    bool push(T &value)
+    {
+        for (unsigned attempt = 0;; ++attempt)
+        {
+            if (m_closed.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            if (tryPush(value))
+            {
+                return true;
+            }
+            if (attempt < kSpinAttempts)
+            {
+                backoff(attempt);
+                continue;
+            }
+            park(m_pushWaiters, m_notFull, [this] {
+                // Dequeued first: the later enqueue position is never behind it
+                size_t dequeued = m_dequeuePos.load();
+                return m_enqueuePos.load() - dequeued < capacity();
+            });
+        }
+    }
+
+    /**
+     * @brief Remove the oldest item, waiting for one to arrive.
+     *
+     * @return false once the queue is closed and empty.
+     */
+    bool pop(T &value)
+    {
+        for (unsigned attempt = 0;; ++attempt)
+        {
+            if (tryPop(value))
+            {
+                return true;
+            }
+            if (m_closed.load(std::memory_order_acquire))
+            {
+                // Items pushed before close() must still come out
+                return tryPop(value);
+            }
+            if (attempt < kSpinAttempts)
+            {
+                backoff(attempt);
+                continue;
+            }
+            park(m_popWaiters, m_notEmpty, [this] {
+                return m_enqueuePos.load() != m_dequeuePos.load();
+            });
+        }
+    }
+
+    /**
+     * @brief Refuse further pushes; consumers drain the remaining items and then stop.
+     */
+    void close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    bool closed() const
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{ 0 };
+        T value{};
+    };
+
+    static constexpr unsigned kSpinAttempts = 128;  ///< Failed attempts before a thread parks: half spinning, half yielding
+
+    // Helper function: spin on the first failed attempts, then yield the processor
+    static void backoff(unsigned attempt)
+    {
+        if (attempt >= kSpinAttempts / 2)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // Helper function: block until ready() or close(). The waiter count is raised before ready() reads the
+    // positions, and wake() reads the count after the push or pop moved a position, all sequentially consistent,
+    // so either ready() sees the move or wake() sees the waiter.
+    template <typename Ready>
+    void park(std::atomic<size_t> &waiters, std::condition_variable &condition, Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waiters.fetch_add(1);
+        condition.wait(lock, [&] {
+            return ready() || m_closed.load(std::memory_order_acquire);
+        });
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Helper function: wake the threads parked on condition, if any; taking the lock orders the notification
+    // after a waiter's check of ready()
+    void wake(std::atomic<size_t> &waiters, std::condition_variable &condition)
+    {
+        if (waiters.load() != 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            condition.notify_all();
+        }
+    }
+
+    static constexpr size_t kCacheLine = 64;
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask = 0;
+    alignas(kCacheLine) std::atomic<size_t> m_enqueuePos{ 0 };
+    alignas(kCacheLine) std::atomic<size_t> m_dequeuePos{ 0 };
+    alignas(kCacheLine) std::atomic<bool> m_closed{ false };
+    std::atomic<size_t> m_pushWaiters{ 0 };  ///< Threads parked in push(); read after every pop
+    std::atomic<size_t> m_popWaiters{ 0 };   ///< Threads parked in pop(); read after every push
+    std::mutex m_mutex;                      ///< Only taken to park and to notify parked threads
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "BackupPack.hpp"
+#include "ConversionObserver.hpp"
+#include "FileConverter.hpp"
+#include "Manifest.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class ConsoleObserver
+ * @brief Prints a conversion run to the console: the roots, files that failed, and the totals.
+ *
+ * Output is fully buffered: lines are collected in memory and written with one fwrite() per buffer full and
+ * at the end of the run, instead of a flush per line, which costs a system call per file on a terminal or
+ * pipe. Failures go to the error stream, everything else to the output stream.
+ */
+class ConsoleObserver : public ConversionObserver
+{
+public:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    explicit ConsoleObserver(std::FILE *out = stdout, std::FILE *err = stderr)
+        : m_out(out)
+        , m_err(err)
+    {
+    }
+
+    ConsoleObserver(const ConsoleObserver &) = delete;
+    ConsoleObserver &operator=(const ConsoleObserver &) = delete;
+
+    ~ConsoleObserver() override
+    {
+        flush();
+    }
+
+    void runStarted(const std::vector<fs::path> &roots, const std::string &target_encoding) override
+    {
+        print(m_out, m_outBuffer, "Starting conversion process...\n");
+        print(m_out, m_outBuffer, "  Target Encoding: " + target_encoding + "\n");
+        for (const fs::path &root : roots)
+        {
+            print(m_out, m_outBuffer, "Processing directory: " + root.string() + "\n");
+        }
+        // Show the header before the run starts; from here on output waits for a full buffer
+        flush();
+    }
+
+    void fileFinished(const FileConversion &file, const ScanProgress &) override
+    {
+        const char *error_msg;
+        switch (file.info.result)
+        {
+        case ConversionResult::Success:
+        case ConversionResult::EmptyFile:
+        case ConversionResult::AlreadyTargetEncoding:
+            return;
+        case ConversionResult::CannotDetectEncoding:
+            error_msg = "Cannot detect encoding";
+            break;
+        case ConversionResult::BackupFailed:
+            error_msg = "Failed to create backup file";
+            break;
+        case ConversionResult::ConversionFailed:
+            error_msg = "Conversion failed";
+            break;
+        default:
+            error_msg = "Unknown error";
+            break;
+        }
+        // Paths are quoted the way operator<< quotes them
+        std::ostringstream line;
+        line << "Error processing file " << file.path << ": " << error_msg << "\n";
+        print(m_err, m_errBuffer, line.str());
+    }
+
+    void runFinished(const ConversionSummary &summary) override
+    {
+        if (summary.manifest)
+        {
+            print(m_out, m_outBuffer, "  manifest: " + std::to_string(summary.manifest->keptCount()) + " unchanged files skipped\n");
+        }
+        if (summary.backupPack)
+        {
+            print(m_out, m_outBuffer,
+                "  backup pack: " + std::to_string(summary.backupPack->size()) + " files, " + std::to_string(summary.backupPack->storedCount()) + " distinct\n");
+        }
+        print(m_out, m_outBuffer, "  iconv descriptors: " + std::to_string(summary.iconv.misses) + " opened, " + std::to_string(summary.iconv.hits) + " reused\n");
+        print(m_out, m_outBuffer, "Conversion process finished.\n");
+        flush();
+    }
+
+    /**
+     * @brief Write out everything buffered so far, failures first.
+     */
+    void flush()
+    {
+        write(m_err, m_errBuffer);
+        write(m_out, m_outBuffer);
+    }
+
+private:
+    static void print(std::FILE *stream, std::string &buffer, std::string_view text)
+    {
+        buffer.append(text.data(), text.size());
+        if (buffer.size() >= kBufferSize)
+        {
+            write(stream, buffer);
+        }
+    }
+
+    static void write(std::FILE *stream, std::string &buffer)
+    {
+        if (!buffer.empty())
+        {
+            std::fwrite(buffer.data(), 1, buffer.size(), stream);
+            std::fflush(stream);
+            buffer.clear();
+        }
+    }
+
+    std::FILE *m_out;
+    std::FILE *m_err;
+    std::string m_outBuffer;
+    std::string m_errBuffer;
+};
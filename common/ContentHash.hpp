@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * @struct ContentKey
+ * @brief Identifies file contents by their 64-bit hash and their size
+ *
+ * Two different contents with the same key would need a 64-bit hash collision between files of the same
+ * size, which is too unlikely to matter for the number of files in a tree.
+ */
+struct ContentKey
+{
+    uint64_t hash = 0;
+    uint64_t size = 0;
+
+    bool operator==(const ContentKey &other) const
+    {
+        return hash == other.hash && size == other.size;
+    }
+
+    /**
+     * @brief Hash the contents with XXH64.
+     */
+    static ContentKey of(std::string_view bytes)
+    {
+        return ContentKey{ xxh64(bytes.data(), bytes.size()), bytes.size() };
+    }
+
+    /**
+     * @brief XXH64 of a block of memory: a non-cryptographic hash running at memory bandwidth.
+     *
+     * Words are read in host byte order, so the value matches the reference implementation on
+     * little-endian machines only. It is only compared within one run, so that does not matter.
+     */
+    static uint64_t xxh64(const void *data, size_t length, uint64_t seed = 0)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        const unsigned char *end = p + length;
+        uint64_t h;
+
+        if (length >= 32)
+        {
+            uint64_t v1 = seed + kPrime1 + kPrime2;
+            uint64_t v2 = seed + kPrime2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - kPrime1;
+            const unsigned char *limit = end - 32;
+            do
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        }
+        else
+        {
+            h = seed + kPrime5;
+        }
+        h += static_cast<uint64_t>(length);
+
+        while (end - p >= 8)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * kPrime1 + kPrime4;
+            p += 8;
+        }
+        if (end - p >= 4)
+        {
+            h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+            h = rotl(h, 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        while (p < end)
+        {
+            h ^= *p * kPrime5;
+            h = rotl(h, 11) * kPrime1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+    static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+    static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+    static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+    static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * kPrime2;
+        acc = rotl(acc, 31);
+        return acc * kPrime1;
+    }
+
+    static uint64_t merge(uint64_t acc, uint64_t value)
+    {
+        acc ^= round(0, value);
+        return acc * kPrime1 + kPrime4;
+    }
+
+    static uint64_t read64(const unsigned char *p)
+    {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t read32(const unsigned char *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+};
+
+/**
+ * @struct ContentKeyHash
+ * @brief Hash functor for unordered containers keyed by ContentKey
+ */
+struct ContentKeyHash
+{
+    size_t operator()(const ContentKey &key) const
+    {
+        return static_cast<size_t>(key.hash);
+    }
+};
+
+/**
+ * @class ContentCache
+ * @brief Thread-safe map from file contents to a result computed from them, with a memory budget.
+ *
+ * Used to reuse the work done for one copy of a file, e.g. a header vendored into several directories, for
+ * every other copy. The map is split into shards with a mutex each, so threads looking up different keys
+ * rarely wait for each other. Once the entries inserted add up to the budget, further inserts are dropped;
+ * entries already cached stay, since a tree's duplicates tend to turn up throughout the run.
+ */
+template <typename Value>
+class ContentCache
+{
+public:
+    /**
+     * @param budget Bytes of cached values at most, as counted by the callers of insert().
+     */
+    explicit ContentCache(size_t budget)
+        : m_budget(budget)
+    {
+    }
+
+    ContentCache(const ContentCache &) = delete;
+    ContentCache &operator=(const ContentCache &) = delete;
+
+    /**
+     * @brief The value cached for the contents, or null.
+     */
+    std::shared_ptr<const Value> find(const ContentKey &key)
+    {
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end())
+        {
+            return nullptr;
+        }
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    /**
+     * @brief Cache a value unless the budget is used up or the key is already present.
+     *
+     * @param bytes Memory the value takes, counted against the budget.
+     */
+    void insert(const ContentKey &key, std::shared_ptr<const Value> value, size_t bytes)
+    {
+        if (m_used.fetch_add(bytes, std::memory_order_relaxed) + bytes > m_budget)
+        {
+            m_used.fetch_sub(bytes, std::memory_order_relaxed);
+            return;
+        }
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.entries.emplace(key, std::move(value)).second)
+        {
+            m_used.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Number of successful find() calls.
+     */
+    size_t hits() const
+    {
+        return m_hits.load();
+    }
+
+private:
+    static constexpr size_t kShards = 16;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<ContentKey, std::shared_ptr<const Value>, ContentKeyHash> entries;
+    };
+
+    Shard &shardOf(const ContentKey &key)
+    {
+        return m_shards[(key.hash >> 56) % kShards];
+    }
+
+    size_t m_budget;
+    std::atomic<size_t> m_used{ 0 };
+    std::atomic<size_t> m_hits{ 0 };
+    Shard m_shards[kShards];
+};
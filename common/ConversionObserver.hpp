@@ -0,0 +1,73 @@
+#pragma once
+
+#include "DirectoryWalker.hpp"
+#include "IconvCache.hpp"
+#include "StageStats.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct FileConversion;
+class Manifest;
+class BackupPack;
+
+/**
+ * @struct ConversionSummary
+ * @brief Totals of a conversion run, passed to ConversionObserver::runFinished
+ */
+struct ConversionSummary
+{
+    size_t filesMatched = 0;    ///< Files selected by the walk, including those skipped through the manifest
+    size_t filesReported = 0;   ///< Files passed to ConversionObserver::fileFinished
+    size_t filesConverted = 0;  ///< Reported files that were rewritten
+    size_t filesFailed = 0;     ///< Reported files that could not be detected, backed up or converted
+    double seconds = 0;         ///< Wall time of the run
+    bool stopped = false;       ///< The stop flag ended the run early
+    IconvCache::Stats iconv;    ///< iconv descriptor statistics summed over the converters
+    StageStats stages;          ///< Latencies and bytes per stage; empty unless PipelineOptions::stageStats is set
+    const Manifest *manifest = nullptr;      ///< The run's manifest, if any
+    const BackupPack *backupPack = nullptr;  ///< The run's backup pack, if any
+};
+
+/**
+ * @class ConversionObserver
+ * @brief Receives the progress and results of a conversion run; implemented by each frontend.
+ *
+ * Pass an observer to FileConverter::convertTree instead of a ResultSink. fileFinished() runs on the thread
+ * of the run's ResultSink, one file at a time and in completion order, so an observer needs no locking of
+ * its own, and a slow one, e.g. updating a window, does not hold back the conversion. runStarted() and
+ * runFinished() run on the thread that called convertTree.
+ */
+class ConversionObserver
+{
+public:
+    virtual ~ConversionObserver() = default;
+
+    /**
+     * @brief The run is about to walk the roots.
+     */
+    virtual void runStarted(const std::vector<fs::path> &roots, const std::string &target_encoding)
+    {
+        (void)roots;
+        (void)target_encoding;
+    }
+
+    /**
+     * @brief A file is done; file.elapsed tells how long it took from the start of reading.
+     *
+     * @param progress Walk counters of the run, e.g. for progress.estimatedTotal().
+     */
+    virtual void fileFinished(const FileConversion &file, const ScanProgress &progress) = 0;
+
+    /**
+     * @brief The run is over and every fileFinished() call has returned. Not called if the run throws.
+     */
+    virtual void runFinished(const ConversionSummary &summary)
+    {
+        (void)summary;
+    }
+};
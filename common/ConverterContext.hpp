@@ -0,0 +1,93 @@
+#pragma once
+
+#include "DetectorPool.hpp"
+#include "IconvCache.hpp"
+#include "OutputSizing.hpp"
+#include "StageStats.hpp"
+#include "StreamingConverter.hpp"
+
+/**
+ * @class ConverterContext
+ * @brief Per-thread state reused by FileConverter across files.
+ *
+ * A context owns resources that are expensive to create but cheap to reset, such as iconv descriptors
+ * and a uchardet detector leased from DetectorPool::shared().
+ * Create one context per worker thread and pass it to the FileConverter overloads that take a context;
+ * the overloads without one use forCurrentThread(). A context must not be shared between threads.
+ */
+class ConverterContext
+{
+public:
+    ConverterContext() = default;
+    ConverterContext(const ConverterContext &) = delete;
+    ConverterContext &operator=(const ConverterContext &) = delete;
+
+    /**
+     * @brief Context owned by the calling thread, created on first use.
+     */
+    static ConverterContext &forCurrentThread()
+    {
+        thread_local ConverterContext context;
+        return context;
+    }
+
+    IconvCache &iconvCache()
+    {
+        return m_iconvCache;
+    }
+
+    const IconvCache::Stats &iconvStats() const
+    {
+        return m_iconvCache.stats();
+    }
+
+    /**
+     * @brief Detector leased by this context, acquired on first use and held until destruction.
+     *
+     * Callers must uchardet_reset the detector before feeding a new file.
+     */
+    uchardet_t detector()
+    {
+        if (!m_detector)
+        {
+            m_detector = DetectorPool::shared().acquire();
+        }
+        return m_detector.get();
+    }
+
+    /**
+     * @brief Settings for the streaming path used on large files.
+     */
+    StreamingOptions &streamingOptions()
+    {
+        return m_streamingOptions;
+    }
+
+    /**
+     * @brief Output buffer policy for in-memory conversions.
+     */
+    OutputSizing &outputSizing()
+    {
+        return m_outputSizing;
+    }
+
+    /**
+     * @brief Where conversions on this context time their stages; null, the default, turns timing off.
+     */
+    StageStats *stageStats() const
+    {
+        return m_stageStats;
+    }
+
+    void setStageStats(StageStats *stats)
+    {
+        m_stageStats = stats;
+    }
+
+private:
+    IconvCache m_iconvCache;
+    OutputSizing m_outputSizing;
+    StreamingOptions m_streamingOptions;
+    DetectorPool::Lease m_detector;
+    StageStats *m_stageStats = nullptr;
+};
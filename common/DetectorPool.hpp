@@ -0,0 +1,154 @@
+#pragma once
+
+#include <mutex>
+#include <stdexcept>
+#include <uchardet.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @class DetectorPool
+ * @brief Recycles uchardet detectors instead of creating one per file.
+ *
+ * uchardet_new allocates every language prober, which dominates the cost of detecting a small file.
+ * Detectors handed out by the pool are reset with uchardet_reset when they come back, so a worker thread
+ * that holds one lease for its lifetime only pays for the byte scan on each file. The pool itself is
+ * thread-safe; a single lease must only be used by one thread at a time.
+ */
+class DetectorPool
+{
+public:
+    /**
+     * @class Lease
+     * @brief Exclusive use of one pooled detector; returns it to the pool on destruction.
+     */
+    class Lease
+    {
+    public:
+        Lease() = default;
+
+        Lease(DetectorPool *pool, uchardet_t detector)
+            : m_pool(pool)
+            , m_detector(detector)
+        {
+        }
+
+        Lease(Lease &&other) noexcept
+            : m_pool(std::exchange(other.m_pool, nullptr))
+            , m_detector(std::exchange(other.m_detector, nullptr))
+        {
+        }
+
+        Lease &operator=(Lease &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                m_pool = std::exchange(other.m_pool, nullptr);
+                m_detector = std::exchange(other.m_detector, nullptr);
+            }
+            return *this;
+        }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        ~Lease()
+        {
+            release();
+        }
+
+        uchardet_t get() const
+        {
+            return m_detector;
+        }
+
+        explicit operator bool() const
+        {
+            return m_detector != nullptr;
+        }
+
+        void release()
+        {
+            if (m_pool && m_detector)
+            {
+                m_pool->recycle(m_detector);
+            }
+            m_pool = nullptr;
+            m_detector = nullptr;
+        }
+
+    private:
+        DetectorPool *m_pool = nullptr;
+        uchardet_t m_detector = nullptr;
+    };
+
+    DetectorPool() = default;
+    DetectorPool(const DetectorPool &) = delete;
+    DetectorPool &operator=(const DetectorPool &) = delete;
+
+    ~DetectorPool()
+    {
+        for (uchardet_t detector : m_idle)
+        {
+            uchardet_delete(detector);
+        }
+    }
+
+    /**
+     * @brief Process-wide pool used by ConverterContext.
+     */
+    static DetectorPool &shared()
+    {
+        static DetectorPool pool;
+        return pool;
+    }
+
+    /**
+     * @brief Take an idle detector, or create one if none is available.
+     *
+     * @return Lease holding a detector in its initial state.
+     * @throws std::runtime_error if uchardet cannot allocate a detector.
+     */
+    Lease acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_idle.empty())
+            {
+                uchardet_t detector = m_idle.back();
+                m_idle.pop_back();
+                return Lease(this, detector);
+            }
+            ++m_created;
+        }
+
+        uchardet_t detector = uchardet_new();
+        if (!detector)
+        {
+            throw std::runtime_error("Failed to create uchardet detector.");
+        }
+        return Lease(this, detector);
+    }
+
+    /**
+     * @brief Number of detectors this pool has created so far.
+     */
+    size_t created() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_created;
+    }
+
+private:
+    void recycle(uchardet_t detector)
+    {
+        uchardet_reset(detector);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(detector);
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<uchardet_t> m_idle;
+    size_t m_created = 0;
+};
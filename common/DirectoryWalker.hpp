@@ -0,0 +1,455 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * @struct ScanProgress
+ * @brief Counters updated while a directory walk runs, for progress estimates
+ *
+ * DirectoryWalker maintains all counters except filesMatched, which belongs to the code that selects files
+ * from the ones visited. All of them can be read from any thread while the walk runs.
+ */
+struct ScanProgress
+{
+    std::atomic<size_t> directoriesFound{ 0 };   ///< Roots plus subdirectories found so far
+    std::atomic<size_t> directoriesListed{ 0 };  ///< Directories whose listing is complete
+    std::atomic<size_t> filesFound{ 0 };         ///< Regular files in the listed directories
+    std::atomic<size_t> filesVisited{ 0 };       ///< Regular files handed to the visitor
+    std::atomic<size_t> filesMatched{ 0 };       ///< Visited files that were selected
+    std::atomic<bool> finished{ false };         ///< The walk is over, so filesMatched is final
+
+    /**
+     * @brief Estimated number of files that will be selected by the end of the walk.
+     *
+     * Assumes directories not yet listed hold as many files as the listed ones on average, and that files
+     * not yet visited are selected at the rate seen so far. The estimate firms up as the walk proceeds and is
+     * exact once it has finished.
+     */
+    size_t estimatedTotal() const
+    {
+        size_t matched = filesMatched.load();
+        size_t visited = filesVisited.load();
+        size_t listed = directoriesListed.load();
+        if (finished.load() || visited == 0 || listed == 0)
+        {
+            return matched;
+        }
+        double files = static_cast<double>(filesFound.load()) * static_cast<double>(std::max(directoriesFound.load(), listed)) / listed;
+        double estimate = files * matched / visited;
+        return std::max(matched, static_cast<size_t>(estimate));
+    }
+};
+
+/**
+ * @class DirectoryWalker
+ * @brief Recursive directory traversal that lists many directories at once.
+ *
+ * A single recursive_directory_iterator waits for one directory listing after another, which is slow on
+ * network file systems and on trees with very many directories. The walker keeps a shared queue of
+ * directories still to be listed; each of its threads takes one, lists it, queues the subdirectories it
+ * found and hands the regular files to the visitor, so the round trips for different directories overlap.
+ * Symbolic links to directories are not followed, as with recursive_directory_iterator.
+ *
+ * By default files are visited as soon as they are found, from the walker threads, in no particular order.
+ * In ordered mode the threads only list directories, and the calling thread visits the files in a
+ * deterministic order: depth first, each directory's files sorted by name before its sorted
+ * subdirectories. Listings that are ready before their turn are held in memory until they are visited, so
+ * the threads list directories close to the visiting order first, and stop starting new listings while
+ * kMaxHeldEntries listed entries wait for the visitor. When the visitor reaches a directory no thread has
+ * started on, it lists that directory itself.
+ */
+class DirectoryWalker
+{
+public:
+    /**
+     * @brief Called for each regular file; returns false to end the walk.
+     */
+    using Visitor = std::function<bool(const fs::directory_entry &)>;
+
+    /**
+     * @brief Ordered mode: listed files and subdirectories that may wait for the visitor before the threads stop
+     *        starting new listings; a few megabytes of entries. Listings under way are finished, so a huge
+     *        directory can exceed it.
+     */
+    static constexpr size_t kMaxHeldEntries = 64 * 1024;
+
+    /**
+     * @param threads Number of threads listing directories; 0 uses defaultThreadCount().
+     * @param ordered Whether files are visited in a deterministic order on the calling thread.
+     */
+    explicit DirectoryWalker(size_t threads = 0, bool ordered = false)
+        : m_threads(threads ? threads : defaultThreadCount())
+        , m_ordered(ordered)
+    {
+    }
+
+    /**
+     * @brief Hardware concurrency capped at 8, or 1 if it cannot be determined.
+     *
+     * Listing is bound by I/O latency rather than CPU, and a handful of outstanding requests is enough to
+     * keep a file server busy.
+     */
+    static size_t defaultThreadCount()
+    {
+        return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 8);
+    }
+
+    /**
+     * @brief Visit every regular file under the given directories.
+     *
+     * In unordered mode the visitor runs on several threads at once and must be thread-safe.
+     *
+     * @param roots Directories to walk recursively.
+     * @param visit Receives each regular file.
+     * @param stop Optional flag; once set, the walk ends.
+     * @param progress Optional counters updated as the walk proceeds; finished is set when walk() returns or throws.
+     * @throws std::filesystem::filesystem_error if a directory cannot be listed, or whatever the visitor throws.
+     */
+    void walk(const std::vector<fs::path> &roots, const Visitor &visit, const std::atomic<bool> *stop = nullptr, ScanProgress *progress = nullptr) const
+    {
+        Walk state(m_ordered, visit, stop, progress);
+        std::vector<std::shared_ptr<Directory>> root_dirs;
+        for (const fs::path &root : roots)
+        {
+            root_dirs.push_back(std::make_shared<Directory>(root));
+            state.queue.push_back(root_dirs.back());
+        }
+        if (m_ordered)
+        {
+            // Listed from the back, like the subdirectories queued by list()
+            std::reverse(state.queue.begin(), state.queue.end());
+        }
+        state.active = root_dirs.size();
+        if (progress)
+        {
+            progress->directoriesFound += root_dirs.size();
+        }
+
+        // Unordered walks use the calling thread as one of the listing threads
+        size_t helpers = m_ordered ? m_threads : m_threads - 1;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            threads.emplace_back([&state] {
+                state.work();
+            });
+        }
+
+        try
+        {
+            if (m_ordered)
+            {
+                state.visitInOrder(root_dirs);
+            }
+            else
+            {
+                state.work();
+            }
+        }
+        catch (...)
+        {
+            state.fail(std::current_exception());
+        }
+
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        if (progress)
+        {
+            progress->finished = true;
+        }
+        if (state.error)
+        {
+            std::rethrow_exception(state.error);
+        }
+    }
+
+private:
+    struct Directory
+    {
+        explicit Directory(fs::path p)
+            : path(std::move(p))
+        {
+        }
+
+        fs::path path;
+        bool taken = false;                                ///< Ordered mode: a thread has started listing it
+        bool listed = false;                               ///< Ordered mode: files and subdirectories are filled in
+        std::vector<fs::directory_entry> files;            ///< Ordered mode: regular files, sorted by name
+        std::vector<std::shared_ptr<Directory>> subdirs;   ///< Ordered mode: subdirectories, sorted by name
+    };
+
+    /**
+     * @struct Walk
+     * @brief State shared by the threads of one walk() call
+     */
+    struct Walk
+    {
+        Walk(bool ordered_mode, const Visitor &visitor, const std::atomic<bool> *stop_flag, ScanProgress *scan_progress)
+            : ordered(ordered_mode)
+            , visit(visitor)
+            , stop(stop_flag)
+            , progress(scan_progress)
+        {
+        }
+
+        bool ordered;
+        const Visitor &visit;
+        const std::atomic<bool> *stop;
+        ScanProgress *progress;
+
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable listed;
+        std::deque<std::shared_ptr<Directory>> queue;  ///< Unordered mode takes from the front, ordered mode from the back
+        size_t active = 0;  ///< Directories queued or being listed
+        size_t held = 0;    ///< Ordered mode: files and subdirectories listed and not yet taken by the visitor
+        std::atomic<bool> cancelled{ false };
+        std::exception_ptr error;
+
+        bool stopping()
+        {
+            if (stop && stop->load())
+            {
+                cancel();
+            }
+            return cancelled.load();
+        }
+
+        void cancel()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cancelled = true;
+            }
+            workAvailable.notify_all();
+            listed.notify_all();
+        }
+
+        void fail(std::exception_ptr exception)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                {
+                    error = exception;
+                }
+            }
+            cancel();
+        }
+
+        // Helper function: list queued directories until none are left or the walk is cancelled
+        void work()
+        {
+            while (true)
+            {
+                std::shared_ptr<Directory> dir;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    workAvailable.wait(lock, [this] {
+                        return (!queue.empty() && (!ordered || held < kMaxHeldEntries)) || active == 0 || cancelled;
+                    });
+                    if (cancelled || queue.empty())
+                    {
+                        return;
+                    }
+                    if (!ordered)
+                    {
+                        dir = std::move(queue.front());
+                        queue.pop_front();
+                    }
+                    else
+                    {
+                        // Depth first, so that the listings the visitor needs next are ready first
+                        dir = std::move(queue.back());
+                        queue.pop_back();
+                        if (dir->taken)
+                        {
+                            // The visitor listed it already, and counted it off
+                            continue;
+                        }
+                        dir->taken = true;
+                    }
+                }
+
+                try
+                {
+                    if (!stopping())
+                    {
+                        list(*dir);
+                    }
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--active == 0)
+                {
+                    workAvailable.notify_all();
+                }
+            }
+        }
+
+        // Helper function: list one directory, queue its subdirectories and visit or store its files
+        void list(Directory &dir)
+        {
+            std::vector<fs::directory_entry> files;
+            std::vector<std::shared_ptr<Directory>> subdirs;
+            for (const fs::directory_entry &entry : fs::directory_iterator(dir.path))
+            {
+                if (entry.is_directory() && !entry.is_symlink())
+                {
+                    subdirs.push_back(std::make_shared<Directory>(entry.path()));
+                }
+                else if (entry.is_regular_file())
+                {
+                    files.push_back(entry);
+                }
+            }
+
+            if (ordered)
+            {
+                auto by_path = [](const auto &a, const auto &b) {
+                    return a.path() < b.path();
+                };
+                std::sort(files.begin(), files.end(), by_path);
+                std::sort(subdirs.begin(), subdirs.end(), [](const std::shared_ptr<Directory> &a, const std::shared_ptr<Directory> &b) {
+                    return a->path < b->path;
+                });
+            }
+
+            if (progress)
+            {
+                progress->directoriesFound += subdirs.size();
+                progress->filesFound += files.size();
+                progress->directoriesListed += 1;
+            }
+            // Queue the subdirectories before visiting anything, so that other threads can start on them
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                active += subdirs.size();
+                if (!ordered)
+                {
+                    queue.insert(queue.end(), subdirs.begin(), subdirs.end());
+                }
+                else
+                {
+                    queue.insert(queue.end(), subdirs.rbegin(), subdirs.rend());
+                    held += files.size() + subdirs.size();
+                    dir.files = std::move(files);
+                    dir.subdirs = std::move(subdirs);
+                    dir.listed = true;
+                }
+            }
+            workAvailable.notify_all();
+            if (ordered)
+            {
+                listed.notify_all();
+                return;
+            }
+            visitFiles(files);
+        }
+
+        // Helper function: hand files to the visitor; returns false once the walk should end
+        bool visitFiles(const std::vector<fs::directory_entry> &files)
+        {
+            for (const fs::directory_entry &file : files)
+            {
+                if (stopping())
+                {
+                    return false;
+                }
+                if (progress)
+                {
+                    progress->filesVisited += 1;
+                }
+                if (!visit(file))
+                {
+                    cancel();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Helper function: visit the files depth first in listing order, listing directories no thread has taken yet
+        void visitInOrder(const std::vector<std::shared_ptr<Directory>> &roots)
+        {
+            std::vector<std::shared_ptr<Directory>> pending(roots.rbegin(), roots.rend());
+            while (!pending.empty())
+            {
+                std::shared_ptr<Directory> dir = std::move(pending.back());
+                pending.pop_back();
+
+                bool list_here = false;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    list_here = !dir->taken;
+                    dir->taken = true;
+                }
+                if (list_here)
+                {
+                    // Its queue entry is skipped by the threads; the threads may also be held back by kMaxHeldEntries
+                    if (stopping())
+                    {
+                        return;
+                    }
+                    list(*dir);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (--active == 0)
+                    {
+                        workAvailable.notify_all();
+                    }
+                }
+
+                std::vector<fs::directory_entry> files;
+                std::vector<std::shared_ptr<Directory>> subdirs;
+                bool was_full = false;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    listed.wait(lock, [this, &dir] {
+                        return dir->listed || cancelled;
+                    });
+                    if (cancelled)
+                    {
+                        return;
+                    }
+                    files = std::move(dir->files);
+                    subdirs = std::move(dir->subdirs);
+                    was_full = held >= kMaxHeldEntries;
+                    held -= files.size() + subdirs.size();
+                }
+                if (was_full)
+                {
+                    workAvailable.notify_all();
+                }
+
+                if (!visitFiles(files))
+                {
+                    return;
+                }
+                pending.insert(pending.end(), subdirs.rbegin(), subdirs.rend());
+            }
+        }
+    };
+
+    size_t m_threads;
+    bool m_ordered;
+};
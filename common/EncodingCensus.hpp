@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct CensusCount
+ * @brief Number of files and their total size
+ */
+struct CensusCount
+{
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+
+    void add(const CensusCount &other)
+    {
+        files += other.files;
+        bytes += other.bytes;
+    }
+};
+
+/**
+ * @class EncodingCensus
+ * @brief Histogram of detected encodings over a set of files, broken down by extension and by directory.
+ *
+ * Built by FileConverter::auditTree. Censuses of disjoint sets of files can be combined with merge(), which
+ * lets each worker thread count on its own and merge once at the end.
+ */
+class EncodingCensus
+{
+public:
+    using Histogram = std::map<std::string, CensusCount>;  ///< Encoding name to count
+
+    /**
+     * @brief Count one file.
+     *
+     * @param encoding Detected encoding, or a label such as "Unknown" or "Empty".
+     * @param extension File extension including the dot, or an empty string.
+     * @param directory Directory the file is grouped under.
+     * @param bytes File size.
+     */
+    void add(const std::string &encoding, const std::string &extension, const std::string &directory, uint64_t bytes)
+    {
+        CensusCount count{ 1, bytes };
+        m_byEncoding[encoding].add(count);
+        m_byExtension[extension.empty() ? "(none)" : extension][encoding].add(count);
+        m_byDirectory[directory][encoding].add(count);
+    }
+
+    void merge(const EncodingCensus &other)
+    {
+        mergeHistogram(m_byEncoding, other.m_byEncoding);
+        for (const auto &[extension, histogram] : other.m_byExtension)
+        {
+            mergeHistogram(m_byExtension[extension], histogram);
+        }
+        for (const auto &[directory, histogram] : other.m_byDirectory)
+        {
+            mergeHistogram(m_byDirectory[directory], histogram);
+        }
+    }
+
+    const Histogram &byEncoding() const
+    {
+        return m_byEncoding;
+    }
+
+    const std::map<std::string, Histogram> &byExtension() const
+    {
+        return m_byExtension;
+    }
+
+    const std::map<std::string, Histogram> &byDirectory() const
+    {
+        return m_byDirectory;
+    }
+
+    CensusCount total() const
+    {
+        return sum(m_byEncoding);
+    }
+
+    /**
+     * @brief Wall-clock time the census took, for throughput figures.
+     */
+    double seconds() const
+    {
+        return m_seconds;
+    }
+
+    void setSeconds(double seconds)
+    {
+        m_seconds = seconds;
+    }
+
+    /**
+     * @brief Write a human-readable report: totals and throughput, then the three histograms.
+     */
+    void print(std::ostream &out) const
+    {
+        CensusCount all = total();
+        out << "Encoding census: " << all.files << " files, " << formatBytes(all.bytes) << " in " << formatNumber(m_seconds, 2) << " s";
+        if (m_seconds > 0)
+        {
+            out << " (" << formatNumber(all.files / m_seconds, 0) << " files/s, " << formatBytes(static_cast<uint64_t>(all.bytes / m_seconds)) << "/s)";
+        }
+        out << '\n';
+
+        out << "\nBy encoding:\n";
+        for (const auto &[encoding, count] : sorted(m_byEncoding))
+        {
+            double share = all.files ? 100.0 * count.files / all.files : 0.0;
+            out << "  " << pad(encoding, 16) << pad(std::to_string(count.files), 10, true) << " files " << pad(formatNumber(share, 1), 6, true) << "%  "
+                << formatBytes(count.bytes) << '\n';
+        }
+
+        printBreakdown(out, "By extension:", m_byExtension);
+        printBreakdown(out, "By directory:", m_byDirectory);
+    }
+
+private:
+    static void mergeHistogram(Histogram &into, const Histogram &from)
+    {
+        for (const auto &[encoding, count] : from)
+        {
+            into[encoding].add(count);
+        }
+    }
+
+    static CensusCount sum(const Histogram &histogram)
+    {
+        CensusCount all;
+        for (const auto &entry : histogram)
+        {
+            all.add(entry.second);
+        }
+        return all;
+    }
+
+    // Helper function: histogram entries by descending file count
+    static std::vector<std::pair<std::string, CensusCount>> sorted(const Histogram &histogram)
+    {
+        std::vector<std::pair<std::string, CensusCount>> entries(histogram.begin(), histogram.end());
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+            return a.second.files > b.second.files;
+        });
+        return entries;
+    }
+
+    static void printBreakdown(std::ostream &out, const char *title, const std::map<std::string, Histogram> &groups)
+    {
+        out << '\n' << title << '\n';
+        for (const auto &[group, histogram] : groups)
+        {
+            CensusCount all = sum(histogram);
+            out << "  " << group << ": " << all.files << " files, " << formatBytes(all.bytes) << " -";
+            for (const auto &[encoding, count] : sorted(histogram))
+            {
+                out << " " << encoding << " " << count.files;
+            }
+            out << '\n';
+        }
+    }
+
+    static std::string pad(const std::string &text, size_t width, bool right = false)
+    {
+        if (text.size() >= width)
+        {
+            return text + " ";
+        }
+        std::string spaces(width - text.size(), ' ');
+        return right ? spaces + text : text + spaces;
+    }
+
+    static std::string formatNumber(double value, int decimals)
+    {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        return buffer;
+    }
+
+    static std::string formatBytes(uint64_t bytes)
+    {
+        static const char *const units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+        double value = static_cast<double>(bytes);
+        size_t unit = 0;
+        while (value >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0]))
+        {
+            value /= 1024;
+            ++unit;
+        }
+        return formatNumber(value, unit ? 1 : 0) + " " + units[unit];
+    }
+
+    Histogram m_byEncoding;
+    std::map<std::string, Histogram> m_byExtension;
+    std::map<std::string, Histogram> m_byDirectory;
+    double m_seconds = 0;
+};
@@ -1,12 +1,43 @@
 #pragma once
 
+#include "AsciiScan.hpp"
+#include "AtomicWriter.hpp"
+#include "BackupFile.hpp"
+#include "BackupPack.hpp"
+#include "BatchIo.hpp"
+#include "ContentHash.hpp"
+#include "ConversionObserver.hpp"
+#include "ConverterContext.hpp"
+#include "DirectoryWalker.hpp"
+#include "EncodingCensus.hpp"
+#include "GbCodec.hpp"
+#include "Manifest.hpp"
+#include "MappedFile.hpp"
+#include "PatternMatcher.hpp"
+#include "Pipeline.hpp"
+#include "Readahead.hpp"
+#include "ResultSink.hpp"
+#include "StageStats.hpp"
+#include "ThreadPool.hpp"
+#include "TraceRecorder.hpp"
+#include "UnicodeTranscoder.hpp"
+#include "Utf8Validator.hpp"
+
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iconv.h>
-#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <uchardet.h>
 #include <vector>
 
@@ -76,16 +107,55 @@ struct ConversionInfo
     }
 };
 
+/**
+ * @struct FileConversion
+ * @brief Outcome of one file in a batch conversion
+ */
+struct FileConversion
+{
+    fs::path path;
+    ConversionInfo info;
+    std::chrono::nanoseconds elapsed{ 0 };  ///< Time from the start of reading the file to its result; 0 if it was not opened
+};
+
+/**
+ * @struct PipelineOptions
+ * @brief Threads per stage and queue depth for FileConverter::convertTree
+ */
+struct PipelineOptions
+{
+    size_t scanners = 0;        ///< Threads listing directories; 0 uses DirectoryWalker::defaultThreadCount()
+    bool orderedScan = false;   ///< Hand files to the readers in a deterministic order; see DirectoryWalker
+    size_t readers = 2;         ///< Threads reading files; more help on network shares and spinning disks
+    size_t converters = 0;      ///< Threads detecting and converting; 0 uses the hardware concurrency
+    size_t writers = 1;         ///< Threads writing converted files
+    size_t queueCapacity = 64;  ///< Files buffered between two stages
+    size_t readahead = 0;       ///< Matched files hinted to the kernel ahead of the readers and released when done; 0 disables
+    WriteMode writeMode = WriteMode::InPlace;            ///< How converted files replace the originals
+    size_t syncBatch = AtomicWriter::kDefaultBatchSize;  ///< Files flushed together with WriteMode::Durable
+    size_t dedupCache = 0;  ///< Bytes of results cached by content hash, so identical files are converted once; 0 disables hashing
+    bool batchIo = false;   ///< Read and write small files in io_uring batches where available; see BatchIo
+    bool stageStats = false;  ///< Time the stages of every file into ConversionSummary::stages; see StageStats
+    TraceRecorder *trace = nullptr;  ///< Receives a trace of every file's stages and of the queue depths; see TraceRecorder
+};
+
 /**
  * @class FileConverter
  * @brief A utility class for batch detecting and converting file encodings.
  *
  * This class uses uchardet for encoding detection and libiconv for conversion, providing a simple interface
  * to process files in specified directories. All methods are static, no need to instantiate the class.
+ * Reusable per-thread state lives in a ConverterContext; overloads without a context argument use the
+ * calling thread's context.
  */
 class FileConverter
 {
 public:
+    /**
+     * @brief Backs up a file that is about to be rewritten; throws if the backup cannot be made.
+     */
+    using BackupFunction = std::function<void(const fs::path &)>;
+
     /**
      * @brief Convert encoding of a single file with detailed information.
      *
@@ -95,65 +165,365 @@ public:
      * @return ConversionInfo containing detailed conversion information.
      */
     static ConversionInfo convertFileWithInfo(const fs::path &filepath, const std::string &target_encoding, bool backup_enabled = false)
+    {
+        return convertFileWithInfo(ConverterContext::forCurrentThread(), filepath, target_encoding, backup_enabled);
+    }
+
+    /**
+     * @brief Convert encoding of a single file using the given converter context.
+     *
+     * The file is replaced by rename where AtomicWriter::canReplaceByRename() allows, and rewritten in place otherwise.
+     *
+     * @param context Converter context owned by the calling thread.
+     * @param filepath Path to the file to convert.
+     * @param target_encoding Target encoding, e.g. "UTF-8".
+     * @param backup_enabled Whether to create a backup file before the file is rewritten; files that need no
+     *                       rewrite are not backed up.
+     * @return ConversionInfo containing detailed conversion information.
+     */
+    static ConversionInfo convertFileWithInfo(
+        ConverterContext &context, const fs::path &filepath, const std::string &target_encoding, bool backup_enabled = false)
     {
         try
         {
-            // Create backup if enabled
+            // Large files take the constant-memory streaming path
+            uint64_t streaming_threshold = context.streamingOptions().threshold;
+            if (streaming_threshold != 0 && fs::file_size(filepath) >= streaming_threshold)
+            {
+                BackupFunction backup;
+                if (backup_enabled)
+                {
+                    backup = [](const fs::path &path) {
+                        BackupFile::create(path, true);
+                    };
+                }
+                return convertFileStreaming(context, filepath, target_encoding, backup);
+            }
+
+            // 1. Map or read file content once
+            StageStats *stats = context.stageStats();
+            StageTimer timer(stats, Stage::Read);
+            MappedFile input(filepath);
+            timer.stop();
+            if (stats)
+            {
+                stats->addInput(input.size());
+            }
+            std::string converted_content;
+            ConversionInfo info = convertBuffer(context, input.bytes(), target_encoding, converted_content);
+            if (info.result != ConversionResult::Success)
+            {
+                return info;
+            }
+
+            // Checked before the backup, which may add a hard link to the file; other files are rewritten in place
+            bool by_rename = AtomicWriter::canReplaceByRename(filepath);
             if (backup_enabled)
             {
+                StageTimer backup_timer(stats, Stage::Backup);
                 try
                 {
-                    createBackupFile(filepath);
+                    BackupFile::create(filepath, by_rename);
                 }
                 catch (const std::exception &e)
                 {
-                    return ConversionInfo(ConversionResult::BackupFailed, "", target_encoding, e.what());
+                    return ConversionInfo(ConversionResult::BackupFailed, info.sourceEncoding, target_encoding, e.what());
                 }
             }
 
-            // 1. Read file content once
-            std::vector<char> file_bytes = readFileAsBytes(filepath);
-            if (file_bytes.empty())
+            // 5. Write file with the BOM of UTF-8-BOM, by rename where possible; the input must be unmapped first
+            input.close();
+            StageTimer write_timer(stats, Stage::Write);
+            std::string_view bom = shouldHaveBom(target_encoding) ? std::string_view("\xEF\xBB\xBF", 3) : std::string_view();
+            std::string error;
+            AtomicWriter writer(by_rename ? WriteMode::Atomic : WriteMode::InPlace);
+            writer.write(filepath, bom, converted_content, [&error](const std::string &outcome) {
+                error = outcome;
+            }, by_rename);
+            if (!error.empty())
             {
-                return ConversionInfo(ConversionResult::EmptyFile, "", target_encoding);
+                return ConversionInfo(ConversionResult::ConversionFailed, info.sourceEncoding, target_encoding, error);
             }
+            write_timer.stop();
+            if (stats)
+            {
+                stats->addOutput(converted_content.size() + bom.size());
+            }
+            return info;
+        }
+        catch (const std::exception &e)
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, e.what());
+        }
+        catch (...)
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, "Unknown error");
+        }
+    }
 
-            // 2. Detect file encoding from buffer
-            std::string source_encoding = detectFileEncodingFromBuffer(file_bytes);
+    /**
+     * @brief Detect the encoding of file contents held in memory and convert them.
+     *
+     * This is the part of convertFileWithInfo between reading and writing the file. On Success, output
+     * holds the bytes to write, without the BOM of UTF-8-BOM; any other result is
+     * final and output is unspecified.
+     *
+     * @param context Converter context owned by the calling thread.
+     * @param file_bytes The whole file.
+     * @param target_encoding Target encoding, e.g. "UTF-8".
+     * @param output Receives the converted bytes.
+     * @return ConversionInfo for the file; Success means the file must be rewritten with output.
+     */
+    static ConversionInfo convertBuffer(ConverterContext &context, std::string_view file_bytes, const std::string &target_encoding, std::string &output)
+    {
+        if (file_bytes.empty())
+        {
+            return ConversionInfo(ConversionResult::EmptyFile, "", target_encoding);
+        }
+
+        // 2. Pure ASCII needs no detection, and no transcoding unless the target differs from ASCII
+        StageTimer timer(context.stageStats(), Stage::Detect);
+        std::string source_encoding;
+        if (isAscii(file_bytes))
+        {
+            if (isAsciiCompatible(target_encoding))
+            {
+                return ConversionInfo(ConversionResult::AlreadyTargetEncoding, "ASCII", target_encoding);
+            }
+            if (shouldHaveBom(target_encoding))
+            {
+                output.assign(file_bytes.data(), file_bytes.size());
+                return ConversionInfo(ConversionResult::Success, "ASCII", target_encoding);
+            }
+            source_encoding = "ASCII";
+        }
+        else
+        {
+            // 3. Detect file encoding from buffer
+            source_encoding = detectFileEncodingFromBuffer(context, file_bytes);
             if (source_encoding.empty())
             {
                 return ConversionInfo(ConversionResult::CannotDetectEncoding, "Unknown", target_encoding);
             }
 
-            // 3. Check if conversion is needed
+            // Check if conversion is needed
             if (source_encoding == target_encoding)
             {
                 return ConversionInfo(ConversionResult::AlreadyTargetEncoding, source_encoding, target_encoding);
             }
+        }
 
-            // 4. Convert encoding
-            std::string converted_content;
-            if (!convertEncoding(file_bytes, source_encoding, target_encoding, converted_content))
+        // 4. Convert encoding
+        timer.next(Stage::Convert);
+        if (!convertEncoding(context, file_bytes, source_encoding, target_encoding, output))
+        {
+            std::string error = "Encoding conversion failed";
+            if (getBaseEncoding(source_encoding) == "UTF-8")
             {
-                return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Encoding conversion failed");
+                Utf8Validation utf8 = validateUtf8(file_bytes);
+                if (!utf8.valid)
+                {
+                    error += ": invalid UTF-8 at byte " + std::to_string(utf8.errorOffset);
+                }
             }
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, error);
+        }
 
-            // 5. Write file (BOM will be added automatically if target is UTF-8-BOM)
-            if (!writeFile(filepath, converted_content, target_encoding))
+        return ConversionInfo(ConversionResult::Success, source_encoding, target_encoding);
+    }
+
+    /**
+     * @brief Detect the encoding of file contents held in memory, the same way convertBuffer does.
+     *
+     * @param context Converter context owned by the calling thread.
+     * @param file_bytes The whole file.
+     * @return "ASCII" for pure ASCII, the detected encoding (e.g. "UTF-8-BOM", "GBK"), or an empty string if
+     *         the contents are empty or their encoding cannot be detected.
+     */
+    static std::string detectEncoding(ConverterContext &context, std::string_view file_bytes)
+    {
+        if (file_bytes.empty())
+        {
+            return "";
+        }
+        if (isAscii(file_bytes))
+        {
+            return "ASCII";
+        }
+        return detectFileEncodingFromBuffer(context, file_bytes);
+    }
+
+    /**
+     * @brief Detect the encoding of a file without converting it.
+     *
+     * The file is read once. Files at or above the context's streaming threshold are read in chunks and
+     * never reported as "ASCII"; others are mapped or read whole and passed to detectEncoding.
+     *
+     * @param context Converter context owned by the calling thread.
+     * @param filepath File to examine.
+     * @return As detectEncoding.
+     * @throws std::runtime_error or std::filesystem::filesystem_error if the file cannot be read.
+     */
+    static std::string detectFileEncoding(ConverterContext &context, const fs::path &filepath)
+    {
+        uint64_t streaming_threshold = context.streamingOptions().threshold;
+        if (streaming_threshold != 0 && fs::file_size(filepath) >= streaming_threshold)
+        {
+            std::ifstream input(filepath, std::ios::binary);
+            if (!input.is_open())
+            {
+                throw std::runtime_error("Could not open file.");
+            }
+            return detectFileEncodingFromStream(context, input, context.streamingOptions().chunkSize);
+        }
+        MappedFile file(filepath);
+        return detectEncoding(context, file.bytes());
+    }
+
+    /**
+     * @brief Detect the encoding of a file using the calling thread's context.
+     */
+    static std::string detectFileEncoding(const fs::path &filepath)
+    {
+        return detectFileEncoding(ConverterContext::forCurrentThread(), filepath);
+    }
+
+    /**
+     * @brief Convert a file in fixed-size chunks without loading it into memory.
+     *
+     * The file is read twice: once to detect its encoding and once to convert it into a temporary file
+     * next to the original, which then replaces the original. Buffer sizes come from the context's
+     * StreamingOptions. The backup, if any, is made just before the replacement, so BackupFile can use a hard link.
+     *
+     * A symbolic link is followed: the temporary file is created next to its target, which it replaces, and the
+     * link stays a link. Files a rename would not keep intact, such as hard-linked ones, are rewritten in place
+     * from the temporary file; see AtomicWriter::replace().
+     *
+     * @param context Converter context owned by the calling thread.
+     * @param filepath Path to the file to convert.
+     * @param target_encoding Target encoding, e.g. "UTF-8".
+     * @param backup Optional; backs up the file once it is known to need a rewrite.
+     * @param sync Whether the new contents are flushed to disk before the temporary file replaces the original,
+     *             or after the original was rewritten in place.
+     * @return ConversionInfo containing detailed conversion information.
+     */
+    static ConversionInfo convertFileStreaming(ConverterContext &context, const fs::path &filepath, const std::string &target_encoding,
+        const BackupFunction &backup = nullptr, bool sync = false)
+    {
+        const StreamingOptions &options = context.streamingOptions();
+        std::ifstream input(filepath, std::ios::binary);
+        if (!input.is_open())
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, "Could not open file.");
+        }
+        StageStats *stats = context.stageStats();
+        if (stats)
+        {
+            std::error_code ec;
+            uint64_t size = fs::file_size(filepath, ec);
+            stats->addInput(ec ? 0 : size);
+        }
+
+        StageTimer timer(stats, Stage::Detect);
+        std::string source_encoding = detectFileEncodingFromStream(context, input, options.chunkSize);
+        if (source_encoding.empty())
+        {
+            return ConversionInfo(ConversionResult::CannotDetectEncoding, "Unknown", target_encoding);
+        }
+        if (source_encoding == target_encoding)
+        {
+            return ConversionInfo(ConversionResult::AlreadyTargetEncoding, source_encoding, target_encoding);
+        }
+
+        timer.next(Stage::Convert);
+        iconv_t cd = context.iconvCache().acquire(getSourceEncoding(source_encoding), getBaseEncoding(target_encoding));
+        if (cd == (iconv_t)-1)
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Unsupported encoding pair");
+        }
+
+        // Skip the source BOM; the target BOM is written explicitly
+        input.clear();
+        input.seekg(source_encoding == "UTF-8-BOM" ? 3 : 0, std::ios::beg);
+
+        std::error_code link_ec;
+        fs::path target = fs::is_symlink(filepath, link_ec) ? fs::canonical(filepath, link_ec) : filepath;
+        if (link_ec)
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Could not resolve link");
+        }
+        // Checked before the backup, which may add a hard link to the file
+        bool by_rename = AtomicWriter::canReplaceByRename(target);
+        fs::path temp_path = AtomicWriter::createTemporary(target);
+        if (temp_path.empty())
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Failed to create temporary file");
+        }
+        std::string error;
+        bool converted = false;
+        std::streamoff written = 0;
+        {
+            std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+            if (!output.is_open())
             {
                 return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Failed to write file");
             }
+            if (shouldHaveBom(target_encoding))
+            {
+                const unsigned char bom[] = { 0xEF, 0xBB, 0xBF };
+                output.write(reinterpret_cast<const char *>(bom), 3);
+            }
+            converted = StreamingConverter(options).convert(cd, input, output, error);
+            written = output.tellp();
+            output.close();
+            if (converted && !output)
+            {
+                converted = false;
+                error = "Failed to write file";
+            }
+        }
+        input.close();
 
-            return ConversionInfo(ConversionResult::Success, source_encoding, target_encoding);
+        if (converted && sync && by_rename && !AtomicWriter::syncFile(temp_path))
+        {
+            converted = false;
+            error = "Failed to write file";
         }
-        catch (const std::exception &e)
+        if (!converted)
         {
-            return ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, e.what());
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, error);
         }
-        catch (...)
+        if (backup)
         {
-            return ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, "Unknown error");
+            timer.next(Stage::Backup);
+            try
+            {
+                backup(filepath);
+            }
+            catch (const std::exception &e)
+            {
+                std::error_code ec;
+                fs::remove(temp_path, ec);
+                return ConversionInfo(ConversionResult::BackupFailed, source_encoding, target_encoding, e.what());
+            }
+        }
+        timer.next(Stage::Write);
+        if (!AtomicWriter::replace(temp_path, target, by_rename))
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Failed to replace file");
+        }
+        if (sync && !by_rename && !AtomicWriter::syncFile(target))
+        {
+            return ConversionInfo(ConversionResult::ConversionFailed, source_encoding, target_encoding, "Failed to write file");
         }
+        timer.stop();
+        if (stats && written > 0)
+        {
+            stats->addOutput(static_cast<uint64_t>(written));
+        }
+        return ConversionInfo(ConversionResult::Success, source_encoding, target_encoding);
     }
 
     /**
@@ -171,94 +541,833 @@ public:
     }
 
     /**
-     * @brief Batch process files in specified directories and convert their encodings.
+     * @brief Convert a list of files on a pool of worker threads.
      *
-     * @param target_dirs Vector containing all directory paths to process.
-     * @param file_exts Vector containing all file extensions to convert, e.g. {".txt", ".cpp"}.
+     * Each file is a separate task, so idle workers steal files from busy ones. Every worker converts with
+     * its own thread's ConverterContext, configured with the streaming options and output sizing of the
+     * calling thread's context. Results go to the sink as files finish, which is not the order of files.
+     *
+     * @param pool Workers to run the conversions on.
+     * @param files Files to convert.
      * @param target_encoding Target encoding, e.g. "UTF-8".
      * @param backup_enabled Whether to create backup files before conversion.
+     * @param sink Receives one FileConversion per converted file; flushed before convertFiles returns.
+     * @param stop Optional flag; once set, files that have not started yet are skipped and not reported.
+     * @return iconv descriptor statistics summed over the workers.
      */
-    static void processDirectory(
-        const std::vector<std::string> &target_dirs, const std::vector<std::string> &file_exts, const std::string &target_encoding, bool backup_enabled = false)
+    static IconvCache::Stats convertFiles(ThreadPool &pool, const std::vector<fs::path> &files, const std::string &target_encoding, bool backup_enabled,
+        ResultSink<FileConversion> &sink, const std::atomic<bool> *stop = nullptr)
     {
+        ConverterContext &caller = ConverterContext::forCurrentThread();
+        StreamingOptions streaming = caller.streamingOptions();
+        OutputSizing sizing = caller.outputSizing();
+        std::atomic<uint64_t> iconv_hits{ 0 };
+        std::atomic<uint64_t> iconv_misses{ 0 };
 
-        std::cout << "Starting conversion process..." << std::endl;
-        std::cout << "  Target Encoding: " << target_encoding << std::endl;
+        for (const fs::path &filepath : files)
+        {
+            pool.submit([&, filepath] {
+                if (stop && stop->load())
+                {
+                    return;
+                }
+                ConverterContext &context = ConverterContext::forCurrentThread();
+                context.streamingOptions() = streaming;
+                context.outputSizing() = sizing;
+                IconvCache::Stats before = context.iconvStats();
 
-        for (const auto &target_dir : target_dirs)
+                auto started = std::chrono::steady_clock::now();
+                ConversionInfo info = convertFileWithInfo(context, filepath, target_encoding, backup_enabled);
+
+                const IconvCache::Stats &after = context.iconvStats();
+                iconv_hits += after.hits - before.hits;
+                iconv_misses += after.misses - before.misses;
+                sink.deliver(FileConversion{ filepath, std::move(info), std::chrono::steady_clock::now() - started });
+            });
+        }
+        pool.wait();
+        sink.flush();
+        return IconvCache::Stats{ iconv_hits.load(), iconv_misses.load() };
+    }
+
+    /**
+     * @brief Convert a list of files on a temporary pool of worker threads.
+     *
+     * @param jobs Number of worker threads; 0 uses the hardware concurrency.
+     * @see convertFiles(ThreadPool &, const std::vector<fs::path> &, const std::string &, bool, ResultSink<FileConversion> &, const std::atomic<bool> *)
+     */
+    static IconvCache::Stats convertFiles(const std::vector<fs::path> &files, const std::string &target_encoding, bool backup_enabled, size_t jobs,
+        ResultSink<FileConversion> &sink, const std::atomic<bool> *stop = nullptr)
+    {
+        ThreadPool pool(std::min(jobs ? jobs : ThreadPool::defaultWorkerCount(), std::max<size_t>(files.size(), 1)));
+        return convertFiles(pool, files, target_encoding, backup_enabled, sink, stop);
+    }
+
+    /**
+     * @brief Find and convert the matching files under a set of directories as a pipeline.
+     *
+     * Four stages overlap: a DirectoryWalker lists the directories in parallel, readers load each file,
+     * converters detect and transcode it, and writers back it up and replace it. The stages are connected by bounded
+     * lock-free queues, so disk-bound reading and CPU-bound conversion run at the same time while at most
+     * a few queues' worth of files are held in memory. Files at or above the streaming threshold are
+     * converted by convertFileStreaming in the convert stage. Converters use their own thread's
+     * ConverterContext, configured like the calling thread's context.
+     *
+     * With options.orderedScan, files enter the pipeline in the walker's deterministic order; with one thread
+     * per stage they are also converted and reported in that order.
+     *
+     * With options.dedupCache, readers hash each file's contents (XXH64). A converter that finds the hash in the
+     * cache reuses the detection and conversion result of an identical file converted earlier in the run, and
+     * a backup pack stores identical originals once. Streamed files are not hashed.
+     *
+     * With options.readahead, the walker asks the kernel to start reading the next files as it finds them, so
+     * their reads overlap with the conversion of earlier files even with a single reader; see Readahead.
+     *
+     * With options.batchIo, readers take the queued files in batches and open, read and close each batch with
+     * one io_uring submission per step, and so do writers with WriteMode::InPlace and no backups; see BatchIo. Files the batch
+     * does not handle, such as large ones, and every file where io_uring is unavailable, take the usual path.
+     *
+     * With options.trace, every stage thread records a slice per file, named after the file and containing slices
+     * for its read, detect, convert, backup and write steps, and the pipeline samples its queue depths every
+     * millisecond as counters.
+     *
+     * options.writeMode selects how the writers replace files; see AtomicWriter. With WriteMode::Durable a file
+     * is reported once its batch has been flushed and renamed, and every touched directory is flushed before
+     * convertTree returns. Streamed files are flushed one by one, since their size dominates the cost anyway.
+     *
+     * @param roots Directories to walk recursively.
+     * @param matches Selects the files to convert; called from several threads at once unless options.orderedScan is set.
+     * @param target_encoding Target encoding, e.g. "UTF-8".
+     * @param backup_enabled Whether to back up files before they are rewritten. Backups are reflinks where the file
+     *                       system supports them and hard links otherwise (see BackupFile), so with backups enabled
+     *                       files that AtomicWriter::canReplaceByRename() are replaced by rename even in
+     *                       WriteMode::InPlace. Symbolic links and hard-linked files get a copied backup instead and
+     *                       are rewritten in place.
+     * @param sink Receives one FileConversion per converted file, in completion order; flushed before convertTree returns.
+     * @param options Threads per stage and queue depth.
+     * @param stop Optional flag; once set, the walk ends and files not yet read are skipped and not reported.
+     * @param progress Optional walk counters; filesMatched counts the files handed to the readers, and
+     *                 progress->estimatedTotal() estimates how many files the sink will receive.
+     * @param manifest Optional record of the previous run. Files whose size, modification time and inode match
+     *                 their entry are reported from the entry without being opened; files that end up converted,
+     *                 already in the target encoding, empty or undetectable are recorded for the next run.
+     * @param backup_pack Optional pack that receives the original of every file before it is rewritten, in addition
+     *                    to the ".bak" files of backup_enabled. The caller closes it afterwards. With WriteMode::Durable
+     *                    the pack is flushed to disk before each batch of files is replaced.
+     * @param stats Optional; every stage thread times its files into a StageStats of its own, and the shards are merged
+     *              into stats once the run is over. Batched reads and writes charge each file an equal share of its
+     *              batch; in WriteMode::Durable the write stage includes the batch commits.
+     * @return iconv descriptor statistics summed over the converters.
+     * @throws std::filesystem::filesystem_error if a directory cannot be listed.
+     */
+    static IconvCache::Stats convertTree(const std::vector<fs::path> &roots, const std::function<bool(const fs::path &)> &matches,
+        const std::string &target_encoding, bool backup_enabled, ResultSink<FileConversion> &sink, const PipelineOptions &options = PipelineOptions(),
+        const std::atomic<bool> *stop = nullptr, ScanProgress *progress = nullptr, Manifest *manifest = nullptr, BackupPack *backup_pack = nullptr,
+        StageStats *stats = nullptr)
+    {
+        ConverterContext &caller = ConverterContext::forCurrentThread();
+        StreamingOptions streaming = caller.streamingOptions();
+        OutputSizing sizing = caller.outputSizing();
+        std::atomic<uint64_t> iconv_hits{ 0 };
+        std::atomic<uint64_t> iconv_misses{ 0 };
+
+        // Declared before the writer, whose destructor may still complete writes and count them
+        StageStatsCollector collector(options.trace);
+        auto stage_stats = [&]() -> StageStats * {
+            return stats || options.trace ? &collector.local() : nullptr;
+        };
+        auto trace = [&]() -> ThreadTrace * {
+            return options.trace ? &options.trace->local() : nullptr;
+        };
+        auto stopped = [stop] {
+            return stop && stop->load();
+        };
+        Readahead readahead(options.readahead);
+        auto finish = [&](FileJob &job) {
+            // A rewritten file has a new stamp; failures are not recorded so the next run tries again
+            if (manifest && job.stamped && isSettled(job.info.result) &&
+                (job.info.result != ConversionResult::Success || FileStamp::read(job.path, job.stamp)))
+            {
+                manifest->record(job.path, ManifestEntry{ job.stamp, job.info.sourceEncoding, static_cast<uint8_t>(job.info.result) });
+            }
+            readahead.release(job.path);
+            sink.deliver(FileConversion{ job.path, std::move(job.info), std::chrono::steady_clock::now() - job.started });
+            return false;
+        };
+
+        // Declared after finish, so that the destructor commits pending files while finish is still alive
+        AtomicWriter writer(options.writeMode, options.syncBatch);
+        // InPlace mode with backups: replaces the files a hard link can back up
+        AtomicWriter renamer(WriteMode::Atomic);
+        const bool durable = options.writeMode == WriteMode::Durable;
+        if (backup_pack && durable)
         {
-            fs::path dir_path = target_dir;
-            if (!fs::exists(dir_path))
+            // The pack entries of a batch's files must reach the disk before the files are replaced
+            writer.setBeforeReplace([backup_pack] {
+                return backup_pack->sync() ? std::string() : std::string("Failed to flush backup pack");
+            });
+        }
+        BackupFunction backup_streamed;
+        if (backup_enabled || backup_pack)
+        {
+            backup_streamed = [backup_enabled, backup_pack, durable](const fs::path &path) {
+                if (backup_enabled)
+                {
+                    BackupFile::create(path, true);
+                }
+                if (backup_pack)
+                {
+                    backup_pack->add(path);
+                    if (durable && !backup_pack->sync())
+                    {
+                        throw std::runtime_error("Failed to flush backup pack");
+                    }
+                }
+            };
+        }
+        std::unique_ptr<ContentCache<CachedConversion>> cache;
+        if (options.dedupCache != 0)
+        {
+            cache = std::make_unique<ContentCache<CachedConversion>>(options.dedupCache);
+        }
+        Pipeline<std::unique_ptr<FileJob>> pipeline(options.queueCapacity);
+
+        // Read: load the whole file so that the disk works while other files are converted; batch is null or a completed batch read
+        auto load = [&](FileJob &job, BatchRead *batch) {
+            if (!batch)
             {
-                throw std::runtime_error("Directory does not exist: " + dir_path.string());
+                job.started = std::chrono::steady_clock::now();
+            }
+            try
+            {
+                if (batch && batch->complete && (streaming.threshold == 0 || batch->size < streaming.threshold))
+                {
+                    job.input = MappedFile(std::move(batch->data), batch->size);
+                }
+                else
+                {
+                    job.streaming = streaming.threshold != 0 && fs::file_size(job.path) >= streaming.threshold;
+                    if (!job.streaming)
+                    {
+                        StageTimer timer(stage_stats(), Stage::Read);
+                        job.input = MappedFile(job.path, std::numeric_limits<size_t>::max());
+                    }
+                }
+                // Streamed files are counted as the convert stage reads them
+                StageStats *read_stats = stage_stats();
+                if (read_stats && !job.streaming)
+                {
+                    read_stats->addInput(job.input.size());
+                }
+                if (cache && !job.streaming)
+                {
+                    job.content = ContentKey::of(job.input.bytes());
+                    job.hashed = true;
+                }
             }
-            std::cout << "Processing directory: " << target_dir << std::endl;
+            catch (const std::exception &e)
+            {
+                job.info = ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, e.what());
+                return finish(job);
+            }
+            return true;
+        };
+        if (options.batchIo)
+        {
+            pipeline.addBatchStage("read", options.readers, BatchIo::kDefaultBatchSize,
+                [&](std::vector<std::unique_ptr<FileJob>> &batch, std::vector<bool> &forward) {
+                    thread_local BatchIo io;
+                    TraceSpan span(trace(), "batch", "read");
+                    std::vector<fs::path> paths;
+                    auto started = std::chrono::steady_clock::now();
+                    for (const std::unique_ptr<FileJob> &job : batch)
+                    {
+                        readahead.started();
+                        job->started = started;
+                        paths.push_back(job->path);
+                    }
+                    if (stopped())
+                    {
+                        return;
+                    }
+                    std::vector<BatchRead> reads;
+                    io.read(paths, reads);
+                    if (StageStats *read_stats = stage_stats())
+                    {
+                        auto now = std::chrono::steady_clock::now();
+                        if (read_stats->trace())
+                        {
+                            read_stats->trace()->slice(stageName(Stage::Read), "stage", started, now);
+                        }
+                        std::chrono::nanoseconds share = (now - started) / batch.size();
+                        for (const BatchRead &read : reads)
+                        {
+                            if (read.complete)
+                            {
+                                read_stats->record(Stage::Read, share);
+                            }
+                        }
+                    }
+                    for (size_t i = 0; i < batch.size(); ++i)
+                    {
+                        forward[i] = load(*batch[i], &reads[i]);
+                    }
+                });
+        }
+        else
+        {
+            pipeline.addStage("read", options.readers, [&](std::unique_ptr<FileJob> &job) {
+                readahead.started();
+                TraceSpan span(trace(), "file", "read", job->path);
+                return !stopped() && load(*job, nullptr);
+            });
+        }
 
-            for (const auto &entry : fs::recursive_directory_iterator(dir_path))
+        // Convert: detect and transcode in memory; files that need no rewrite end here
+        size_t converters = options.converters ? options.converters : ThreadPool::defaultWorkerCount();
+        pipeline.addStage("convert", converters, [&](std::unique_ptr<FileJob> &job) {
+            TraceSpan span(trace(), "file", "convert", job->path);
+            ConverterContext &context = ConverterContext::forCurrentThread();
+            context.streamingOptions() = streaming;
+            context.outputSizing() = sizing;
+            context.setStageStats(stage_stats());
+            IconvCache::Stats before = context.iconvStats();
+            try
+            {
+                if (job->hashed)
+                {
+                    job->cached = cache->find(job->content);
+                }
+                if (job->cached)
+                {
+                    job->info = job->cached->info;
+                }
+                else if (job->streaming)
+                {
+                    job->info = convertFileStreaming(context, job->path, target_encoding, backup_streamed, durable);
+                    if (job->info.result == ConversionResult::Success)
+                    {
+                        writer.replaced(job->path);
+                    }
+                }
+                else
+                {
+                    job->info = convertBuffer(context, job->input.bytes(), target_encoding, job->output);
+                    if (job->hashed && isSettled(job->info.result))
+                    {
+                        job->cached = std::make_shared<CachedConversion>(CachedConversion{ job->info, std::move(job->output) });
+                        cache->insert(job->content, job->cached, job->cached->output.size() + sizeof(CachedConversion));
+                    }
+                }
+            }
+            catch (const std::exception &e)
             {
-                if (entry.is_regular_file())
+                job->info = ConversionInfo(ConversionResult::ConversionFailed, "", target_encoding, e.what());
+            }
+            // The original is still in memory here, so packing it costs no extra read
+            if (backup_pack && !job->streaming && job->info.result == ConversionResult::Success)
+            {
+                StageTimer timer(context.stageStats(), Stage::Backup);
+                try
+                {
+                    backup_pack->add(job->path, job->input.bytes(), job->hashed ? &job->content : nullptr);
+                }
+                catch (const std::exception &e)
                 {
-                    std::string current_ext = entry.path().extension().string();
-                    // Check if file extension is in target list
-                    bool extension_match = std::find(file_exts.begin(), file_exts.end(), current_ext) != file_exts.end();
+                    job->info = ConversionInfo(ConversionResult::BackupFailed, job->info.sourceEncoding, target_encoding, e.what());
+                }
+            }
+            job->input.close();
 
-                    if (extension_match)
+            const IconvCache::Stats &after = context.iconvStats();
+            iconv_hits += after.hits - before.hits;
+            iconv_misses += after.misses - before.misses;
+            if (job->streaming || job->info.result != ConversionResult::Success)
+            {
+                return finish(*job);
+            }
+            return true;
+        });
+
+        // Write: back up, then replace the file with the converted bytes; in Durable mode the job is finished when its batch commits
+        std::string_view bom = shouldHaveBom(target_encoding) ? std::string_view("\xEF\xBB\xBF", 3) : std::string_view();
+        auto output_of = [](const FileJob &job) {
+            return job.cached ? std::string_view(job.cached->output) : std::string_view(job.output);
+        };
+        auto write = [&](std::unique_ptr<FileJob> &job) {
+            TraceSpan span(trace(), "file", "write", job->path);
+            StageStats *write_stats = stage_stats();
+            // Checked before the backup, which may add a hard link to the file
+            bool by_rename = (backup_enabled || writer.mode() != WriteMode::InPlace) && AtomicWriter::canReplaceByRename(job->path);
+            AtomicWriter &file_writer = by_rename && writer.mode() == WriteMode::InPlace ? renamer : writer;
+            if (backup_enabled)
+            {
+                StageTimer timer(write_stats, Stage::Backup);
+                try
+                {
+                    BackupFile::create(job->path, by_rename);
+                }
+                catch (const std::exception &e)
+                {
+                    job->info = ConversionInfo(ConversionResult::BackupFailed, job->info.sourceEncoding, target_encoding, e.what());
+                    return finish(*job);
+                }
+            }
+            std::shared_ptr<FileJob> pending(std::move(job));
+            std::string_view output = output_of(*pending);
+            size_t bytes = bom.size() + output.size();
+            StageTimer timer(write_stats, Stage::Write);
+            // The completion may run on another thread when a batch commits, so it counts into that thread's shard
+            file_writer.write(pending->path, bom, output, [&, pending, bytes](const std::string &error) {
+                if (!error.empty())
+                {
+                    pending->info = ConversionInfo(ConversionResult::ConversionFailed, pending->info.sourceEncoding, target_encoding, error);
+                }
+                else if (StageStats *done_stats = stage_stats())
+                {
+                    done_stats->addOutput(bytes);
+                }
+                finish(*pending);
+            }, by_rename);
+            timer.stop();
+            // The bytes are on their way to disk; do not hold them while the batch fills
+            std::string().swap(pending->output);
+            pending->cached.reset();
+            return false;
+        };
+        if (options.batchIo && writer.mode() == WriteMode::InPlace && !backup_enabled)
+        {
+            pipeline.addBatchStage("write", options.writers, BatchIo::kDefaultBatchSize,
+                [&](std::vector<std::unique_ptr<FileJob>> &batch, std::vector<bool> &) {
+                    thread_local BatchIo io;
+                    TraceSpan span(trace(), "batch", "write");
+                    std::vector<BatchWrite> files;
+                    for (const std::unique_ptr<FileJob> &job : batch)
+                    {
+                        files.push_back(BatchWrite{ job->path, bom, output_of(*job) });
+                    }
+                    std::vector<bool> written;
+                    StageStats *write_stats = stage_stats();
+                    auto started = std::chrono::steady_clock::now();
+                    io.write(files, written);
+                    auto now = std::chrono::steady_clock::now();
+                    if (write_stats && write_stats->trace())
                     {
-                        ConversionResult result = convertFile(entry.path(), target_encoding, backup_enabled);
-                        if (result != ConversionResult::Success && result != ConversionResult::EmptyFile && result != ConversionResult::AlreadyTargetEncoding)
+                        write_stats->trace()->slice(stageName(Stage::Write), "stage", started, now);
+                    }
+                    std::chrono::nanoseconds share = (now - started) / batch.size();
+                    for (size_t i = 0; i < batch.size(); ++i)
+                    {
+                        if (written[i])
                         {
-                            std::string error_msg;
-                            switch (result)
+                            if (write_stats)
                             {
-                            case ConversionResult::CannotDetectEncoding:
-                                error_msg = "Cannot detect encoding";
-                                break;
-                            case ConversionResult::BackupFailed:
-                                error_msg = "Failed to create backup file";
-                                break;
-                            case ConversionResult::ConversionFailed:
-                                error_msg = "Conversion failed";
-                                break;
-                            default:
-                                error_msg = "Unknown error";
-                                break;
+                                write_stats->record(Stage::Write, share);
+                                write_stats->addOutput(files[i].prefix.size() + files[i].content.size());
                             }
-                            std::cerr << "Error processing file " << entry.path() << ": " << error_msg << std::endl;
+                            finish(*batch[i]);
+                        }
+                        else
+                        {
+                            write(batch[i]);
                         }
                     }
+                });
+        }
+        else
+        {
+            pipeline.addStage("write", options.writers, write);
+        }
+
+        if (options.trace)
+        {
+            pipeline.sampleQueues(std::chrono::milliseconds(1), [&](const std::vector<size_t> &depths) {
+                std::vector<std::pair<std::string, size_t>> values;
+                for (size_t i = 0; i < depths.size(); ++i)
+                {
+                    values.emplace_back(pipeline.stageName(i), depths[i]);
                 }
+                ThreadTrace *sampler = trace();
+                sampler->nameIfUnnamed("queues");
+                sampler->counter("queued jobs", std::chrono::steady_clock::now(), values);
+            });
+        }
+
+        // Scan: list the directories in parallel and feed matching files straight to the readers
+        pipeline.run([&](const std::function<bool(std::unique_ptr<FileJob> &&)> &emit) {
+            DirectoryWalker walker(options.scanners, options.orderedScan);
+            walker.walk(
+                roots,
+                [&](const fs::directory_entry &entry) {
+                    if (!matches(entry.path()))
+                    {
+                        return true;
+                    }
+                    if (progress)
+                    {
+                        progress->filesMatched += 1;
+                    }
+                    auto job = std::make_unique<FileJob>();
+                    job->path = entry.path();
+                    if (manifest && FileStamp::read(job->path, job->stamp))
+                    {
+                        job->stamped = true;
+                        if (std::optional<ManifestEntry> previous = manifest->find(job->path, job->stamp))
+                        {
+                            manifest->keep(job->path, *previous);
+                            sink.deliver(FileConversion{ job->path, unchangedInfo(*previous, target_encoding) });
+                            return true;
+                        }
+                    }
+                    readahead.schedule(job->path);
+                    return emit(std::move(job));
+                },
+                stop, progress);
+        });
+        writer.flush();
+        sink.flush();
+        if (stats)
+        {
+            stats->merge(collector.merged());
+        }
+
+        return IconvCache::Stats{ iconv_hits.load(), iconv_misses.load() };
+    }
+
+    /**
+     * @brief Convert the matching files under a set of directories, reporting to an observer.
+     *
+     * Runs convertTree with a ResultSink that forwards each file to observer.fileFinished(), between
+     * observer.runStarted() and observer.runFinished(). With options.stageStats the summary also holds the
+     * stage timings of the run.
+     *
+     * @see convertTree(const std::vector<fs::path> &, const std::function<bool(const fs::path &)> &, const std::string &, bool,
+     *      ResultSink<FileConversion> &, const PipelineOptions &, const std::atomic<bool> *, ScanProgress *, Manifest *, BackupPack *, StageStats *)
+     * @return The totals also passed to observer.runFinished().
+     */
+    static ConversionSummary convertTree(const std::vector<fs::path> &roots, const std::function<bool(const fs::path &)> &matches,
+        const std::string &target_encoding, bool backup_enabled, ConversionObserver &observer, const PipelineOptions &options = PipelineOptions(),
+        const std::atomic<bool> *stop = nullptr, Manifest *manifest = nullptr, BackupPack *backup_pack = nullptr)
+    {
+        auto started = std::chrono::steady_clock::now();
+        observer.runStarted(roots, target_encoding);
+
+        ConversionSummary summary;
+        ScanProgress progress;
+        ResultSink<FileConversion> sink([&](const FileConversion &file) {
+            ConversionResult result = file.info.result;
+            summary.filesReported += 1;
+            summary.filesConverted += result == ConversionResult::Success ? 1 : 0;
+            summary.filesFailed += isFailure(result) ? 1 : 0;
+            observer.fileFinished(file, progress);
+        });
+        summary.iconv = convertTree(
+            roots, matches, target_encoding, backup_enabled, sink, options, stop, &progress, manifest, backup_pack, options.stageStats ? &summary.stages : nullptr);
+
+        summary.filesMatched = progress.filesMatched.load();
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        summary.stopped = stop && stop->load();
+        summary.manifest = manifest;
+        summary.backupPack = backup_pack;
+        observer.runFinished(summary);
+        return summary;
+    }
+
+    /**
+     * @brief Batch process files in specified directories and convert their encodings.
+     *
+     * @param target_dirs Vector containing all directory paths to process.
+     * @param file_exts Vector containing all file extensions to convert, e.g. {".txt", ".cpp"}; globs such as "*.tar.gz" also work.
+     * @param target_encoding Target encoding, e.g. "UTF-8".
+     * @param observer Receives the start of the run, every file and the totals; see ConversionObserver.
+     * @param backup_enabled Whether to create backup files before conversion.
+     * @param options Threads per pipeline stage; see convertTree.
+     * @param ignore_case Whether extensions match regardless of ASCII case.
+     * @param manifest Optional record of the previous run, used to skip unchanged files; see convertTree. The caller
+     *                 saves it afterwards.
+     * @param backup_pack Optional pack receiving the originals of rewritten files; see convertTree. The caller closes it
+     *                    afterwards.
+     * @return The totals also passed to the observer.
+     * @throws std::runtime_error if a directory does not exist.
+     */
+    static ConversionSummary processDirectory(const std::vector<std::string> &target_dirs, const std::vector<std::string> &file_exts,
+        const std::string &target_encoding, ConversionObserver &observer, bool backup_enabled = false, const PipelineOptions &options = PipelineOptions(),
+        bool ignore_case = false, Manifest *manifest = nullptr, BackupPack *backup_pack = nullptr)
+    {
+        std::vector<fs::path> roots;
+        for (const auto &target_dir : target_dirs)
+        {
+            fs::path dir_path = target_dir;
+            if (!fs::exists(dir_path))
+            {
+                throw std::runtime_error("Directory does not exist: " + dir_path.string());
             }
+            // Manifest entries and packed backups are keyed by path, so make them independent of the working directory
+            roots.push_back(manifest || backup_pack ? fs::absolute(dir_path) : dir_path);
         }
 
-        std::cout << "Conversion process finished." << std::endl;
+        // Compile the extension list once instead of searching it for every file
+        PatternMatcher extension_match(file_exts, ignore_case);
+        return convertTree(roots, extension_match, target_encoding, backup_enabled, observer, options, nullptr, manifest, backup_pack);
+    }
+
+    /**
+     * @brief Detect the encodings of the matching files under a set of directories without modifying anything.
+     *
+     * Runs as a pipeline like convertTree: a DirectoryWalker lists the directories, readers load each file
+     * and detectors run detection on it, with the same thread counts from options. Each detector counts into
+     * a shard of its own, and the shards are merged at the end. Files that cannot be read are counted as
+     * "Unreadable", empty files as "Empty" and files whose encoding cannot be detected as "Unknown".
+     *
+     * @param roots Directories to walk recursively.
+     * @param matches Selects the files to examine; called from several threads at once unless options.orderedScan is set.
+     * @param options Threads per stage and queue depth; converters is the number of detector threads. readahead works as
+     *                for convertTree.
+     * @param directory_depth Directories below each root that the census groups files by; 0 groups by root.
+     * @param stop Optional flag; once set, the walk ends and files not yet read are left out.
+     * @param progress Optional walk counters, as for convertTree.
+     * @return The census, with the time it took.
+     * @throws std::filesystem::filesystem_error if a directory cannot be listed.
+     */
+    static EncodingCensus auditTree(const std::vector<fs::path> &roots, const std::function<bool(const fs::path &)> &matches,
+        const PipelineOptions &options = PipelineOptions(), size_t directory_depth = 1, const std::atomic<bool> *stop = nullptr,
+        ScanProgress *progress = nullptr)
+    {
+        auto started = std::chrono::steady_clock::now();
+        ConverterContext &caller = ConverterContext::forCurrentThread();
+        StreamingOptions streaming = caller.streamingOptions();
+
+        // Shards keep detectors from contending on one census
+        constexpr size_t kShards = 16;
+        struct Shard
+        {
+            std::mutex mutex;
+            EncodingCensus census;
+        };
+        std::vector<Shard> shards(kShards);
+        auto count = [&](const AuditJob &job, const std::string &encoding) {
+            Shard &shard = shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % kShards];
+            std::string directory = censusDirectory(roots[job.root], job.path, directory_depth);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.census.add(encoding, job.path.extension().string(), directory, job.size);
+        };
+        auto stopped = [stop] {
+            return stop && stop->load();
+        };
+        Readahead readahead(options.readahead);
+
+        Pipeline<std::unique_ptr<AuditJob>> pipeline(options.queueCapacity);
+
+        // Read: load the whole file, unless it is large enough to be detected in chunks
+        pipeline.addStage("read", options.readers, [&](std::unique_ptr<AuditJob> &job) {
+            readahead.started();
+            if (stopped())
+            {
+                return false;
+            }
+            try
+            {
+                job->size = fs::file_size(job->path);
+                job->streaming = streaming.threshold != 0 && job->size >= streaming.threshold;
+                if (!job->streaming)
+                {
+                    job->input = MappedFile(job->path);
+                }
+            }
+            catch (const std::exception &)
+            {
+                count(*job, "Unreadable");
+                readahead.release(job->path);
+                return false;
+            }
+            return true;
+        });
+
+        // Detect: classify the file and count it
+        size_t detectors = options.converters ? options.converters : ThreadPool::defaultWorkerCount();
+        pipeline.addStage("detect", detectors, [&](std::unique_ptr<AuditJob> &job) {
+            ConverterContext &context = ConverterContext::forCurrentThread();
+            context.streamingOptions() = streaming;
+            std::string encoding;
+            try
+            {
+                encoding = job->streaming ? detectFileEncoding(context, job->path) : detectEncoding(context, job->input.bytes());
+                if (encoding.empty())
+                {
+                    encoding = job->size == 0 ? "Empty" : "Unknown";
+                }
+            }
+            catch (const std::exception &)
+            {
+                encoding = "Unreadable";
+            }
+            job->input.close();
+            count(*job, encoding);
+            readahead.release(job->path);
+            return false;
+        });
+
+        pipeline.run([&](const std::function<bool(std::unique_ptr<AuditJob> &&)> &emit) {
+            DirectoryWalker walker(options.scanners, options.orderedScan);
+            walker.walk(
+                roots,
+                [&](const fs::directory_entry &entry) {
+                    if (!matches(entry.path()))
+                    {
+                        return true;
+                    }
+                    if (progress)
+                    {
+                        progress->filesMatched += 1;
+                    }
+                    auto job = std::make_unique<AuditJob>();
+                    job->path = entry.path();
+                    job->root = rootOf(roots, job->path);
+                    readahead.schedule(job->path);
+                    return emit(std::move(job));
+                },
+                stop, progress);
+        });
+
+        EncodingCensus census;
+        for (Shard &shard : shards)
+        {
+            census.merge(shard.census);
+        }
+        census.setSeconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+        return census;
+    }
+
+    /**
+     * @brief Report the encodings of the files in the specified directories without converting them.
+     *
+     * @param target_dirs Vector containing all directory paths to examine.
+     * @param file_exts File extensions or globs to examine, as for processDirectory.
+     * @param options Threads per pipeline stage; see auditTree.
+     * @param ignore_case Whether extensions match regardless of ASCII case.
+     * @param directory_depth Directory levels below each root to group by; see auditTree.
+     * @return The census; printing it is up to the caller, e.g. with EncodingCensus::print().
+     * @throws std::runtime_error if a directory does not exist.
+     */
+    static EncodingCensus auditDirectory(const std::vector<std::string> &target_dirs, const std::vector<std::string> &file_exts,
+        const PipelineOptions &options = PipelineOptions(), bool ignore_case = false, size_t directory_depth = 1)
+    {
+        std::vector<fs::path> roots;
+        for (const auto &target_dir : target_dirs)
+        {
+            fs::path dir_path = target_dir;
+            if (!fs::exists(dir_path))
+            {
+                throw std::runtime_error("Directory does not exist: " + dir_path.string());
+            }
+            roots.push_back(dir_path);
+        }
+
+        PatternMatcher extension_match(file_exts, ignore_case);
+        return auditTree(roots, extension_match, options, directory_depth);
     }
 
 private:
-    // Helper function: create backup file
-    static void createBackupFile(const fs::path &filepath)
+    /**
+     * @struct CachedConversion
+     * @brief Result of converting some contents, reused for identical files
+     */
+    struct CachedConversion
+    {
+        ConversionInfo info;
+        std::string output;  ///< Converted bytes, without BOM; only for Success
+    };
+
+    /**
+     * @struct FileJob
+     * @brief A file travelling through the convertTree pipeline
+     */
+    struct FileJob
+    {
+        fs::path path;
+        MappedFile input;
+        std::string output;
+        ConversionInfo info{ ConversionResult::Success };
+        bool streaming = false;
+        FileStamp stamp;       ///< Size, time and inode when the walk found the file
+        bool stamped = false;  ///< Whether stamp was read; only with a manifest
+        std::chrono::steady_clock::time_point started;  ///< When the reader took the file
+        ContentKey content;    ///< Hash of the input; only with a dedup cache
+        bool hashed = false;   ///< Whether content was computed
+        std::shared_ptr<const CachedConversion> cached;  ///< Result shared with identical files; output is then unused
+    };
+
+    /**
+     * @struct AuditJob
+     * @brief A file travelling through the auditTree pipeline
+     */
+    struct AuditJob
+    {
+        fs::path path;
+        size_t root = 0;  ///< Index of the root the file was found under
+        uint64_t size = 0;
+        MappedFile input;
+        bool streaming = false;
+    };
+
+    // Helper function: index of the root a walked path starts with
+    static size_t rootOf(const std::vector<fs::path> &roots, const fs::path &path)
     {
-        fs::path backup_path = filepath.string() + ".bak";
-        fs::copy_file(filepath, backup_path, fs::copy_options::overwrite_existing);
+        const fs::path::string_type &native = path.native();
+        for (size_t i = 0; i < roots.size(); ++i)
+        {
+            const fs::path::string_type &root = roots[i].native();
+            if (native.compare(0, root.size(), root) == 0)
+            {
+                return i;
+            }
+        }
+        return 0;
     }
 
-    // Helper function: read file content into a byte vector
-    static std::vector<char> readFileAsBytes(const fs::path &filepath)
+    // Helper function: the root plus at most depth directories below it that contain the file
+    static std::string censusDirectory(const fs::path &root, const fs::path &file, size_t depth)
     {
-        std::ifstream file(filepath, std::ios::binary);
-        if (!file.is_open())
+        fs::path group = root;
+        fs::path relative = file.parent_path().lexically_relative(root);
+        for (const fs::path &part : relative)
         {
-            throw std::runtime_error("Could not open file.");
+            if (depth-- == 0 || part == ".")
+            {
+                break;
+            }
+            group /= part;
         }
-        file.seekg(0, std::ios::end);
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        std::vector<char> buffer(static_cast<size_t>(size));
-        file.read(buffer.data(), size);
-        return buffer;
+        return group.generic_string();
+    }
+
+    // Helper function: whether a result stays valid until the file changes, so it can go into the manifest
+    static bool isSettled(ConversionResult result)
+    {
+        return result == ConversionResult::Success || result == ConversionResult::EmptyFile || result == ConversionResult::AlreadyTargetEncoding ||
+               result == ConversionResult::CannotDetectEncoding;
+    }
+
+    // Helper function: whether a result means the file was left unconverted by an error
+    static bool isFailure(ConversionResult result)
+    {
+        return result != ConversionResult::Success && result != ConversionResult::EmptyFile && result != ConversionResult::AlreadyTargetEncoding;
+    }
+
+    // Helper function: report a file skipped because its manifest entry is current
+    static ConversionInfo unchangedInfo(const ManifestEntry &entry, const std::string &target_encoding)
+    {
+        ConversionResult result = static_cast<ConversionResult>(entry.outcome);
+        if (result == ConversionResult::Success)
+        {
+            // Converted last time, so it is in the target encoding now
+            return ConversionInfo(ConversionResult::AlreadyTargetEncoding, target_encoding, target_encoding, "Unchanged since the last run");
+        }
+        return ConversionInfo(result, entry.encoding, target_encoding, "Unchanged since the last run");
     }
 
     // Helper function: check if buffer has UTF-8 BOM
-    static bool hasUtf8Bom(const std::vector<char> &buffer)
+    static bool hasUtf8Bom(std::string_view buffer)
     {
         return buffer.size() >= 3 && 
                static_cast<unsigned char>(buffer[0]) == 0xEF &&
@@ -267,7 +1376,13 @@ private:
     }
 
     // Helper function: detect file encoding from buffer using uchardet and BOM detection
-    static std::string detectFileEncodingFromBuffer(const std::vector<char> &buffer)
+    static std::string detectFileEncodingFromBuffer(std::string_view buffer)
+    {
+        return detectFileEncodingFromBuffer(ConverterContext::forCurrentThread(), buffer);
+    }
+
+    // Helper function: detect file encoding using the context's pooled uchardet detector
+    static std::string detectFileEncodingFromBuffer(ConverterContext &context, std::string_view buffer)
     {
         if (buffer.empty())
         {
@@ -275,23 +1390,10 @@ private:
         }
 
         // Check for UTF-16 BOM first (these are different encodings)
-        if (buffer.size() >= 2)
-        {
-            if (static_cast<unsigned char>(buffer[0]) == 0xFF && static_cast<unsigned char>(buffer[1]) == 0xFE)
-            {
-                return "UTF-16LE";
-            }
-            if (static_cast<unsigned char>(buffer[0]) == 0xFE && static_cast<unsigned char>(buffer[1]) == 0xFF)
-            {
-                return "UTF-16BE";
-            }
-        }
-
-        // Use uchardet for encoding detection
-        uchardet_t detector = uchardet_new();
-        if (!detector)
+        std::string bom_encoding = detectUtf16Bom(buffer.data(), buffer.size());
+        if (!bom_encoding.empty())
         {
-            throw std::runtime_error("Failed to create uchardet detector.");
+            return bom_encoding;
         }
 
         // Skip UTF-8 BOM for detection if present
@@ -303,34 +1405,94 @@ private:
             detect_size -= 3;
         }
 
+        // Well-formed UTF-8 with multibyte sequences is practically never another encoding, and validating
+        // is far cheaper than uchardet's statistical analysis
+        Utf8Validation utf8 = validateUtf8(detect_data, detect_size);
+        if (utf8.valid && utf8.hasMultibyte)
+        {
+            return hasUtf8Bom(buffer) ? "UTF-8-BOM" : "UTF-8";
+        }
+
+        // Use uchardet for encoding detection
+        uchardet_t detector = context.detector();
+        uchardet_reset(detector);
+
         uchardet_handle_data(detector, detect_data, detect_size);
         uchardet_data_end(detector);
 
         const char *charset = uchardet_get_charset(detector);
-        std::string result = charset ? charset : "";
-        uchardet_delete(detector);
+        return mapDetectedCharset(charset ? charset : "", hasUtf8Bom(buffer));
+    }
+
+    // Helper function: detect file encoding chunk by chunk; leaves the stream at end of file
+    static std::string detectFileEncodingFromStream(ConverterContext &context, std::istream &input, size_t chunk_size)
+    {
+        std::vector<char> chunk(std::max<size_t>(chunk_size, 4096));
+        input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        size_t got = static_cast<size_t>(input.gcount());
+        if (got == 0)
+        {
+            return "";
+        }
+
+        std::string bom_encoding = detectUtf16Bom(chunk.data(), got);
+        if (!bom_encoding.empty())
+        {
+            return bom_encoding;
+        }
 
-        // Map common encoding names
+        uchardet_t detector = context.detector();
+        uchardet_reset(detector);
+
+        bool has_bom = hasUtf8Bom(std::string_view(chunk.data(), got));
+        size_t skip = has_bom ? 3 : 0;
+        while (got > 0)
+        {
+            uchardet_handle_data(detector, chunk.data() + skip, got - skip);
+            skip = 0;
+            input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            got = static_cast<size_t>(input.gcount());
+        }
+        uchardet_data_end(detector);
+
+        const char *charset = uchardet_get_charset(detector);
+        return mapDetectedCharset(charset ? charset : "", has_bom);
+    }
+
+    // Helper function: recognise UTF-16 byte order marks
+    static std::string detectUtf16Bom(const char *data, size_t size)
+    {
+        if (size >= 2)
+        {
+            if (static_cast<unsigned char>(data[0]) == 0xFF && static_cast<unsigned char>(data[1]) == 0xFE)
+            {
+                return "UTF-16LE";
+            }
+            if (static_cast<unsigned char>(data[0]) == 0xFE && static_cast<unsigned char>(data[1]) == 0xFF)
+            {
+                return "UTF-16BE";
+            }
+        }
+        return "";
+    }
+
+    // Helper function: map uchardet charset names to the names used by this converter
+    static std::string mapDetectedCharset(const std::string &result, bool has_utf8_bom)
+    {
         if (result == "UTF-8" || result == "ASCII" || result.empty())
         {
             // ASCII is a subset of UTF-8, so treat ASCII with BOM as UTF-8-BOM
-            return hasUtf8Bom(buffer) ? "UTF-8-BOM" : "UTF-8";
+            return has_utf8_bom ? "UTF-8-BOM" : "UTF-8";
         }
         else if (result == "GB18030" || result == "GBK")
         {
+            // Reported under the familiar name; getSourceEncoding reads it back as GB18030
             return "GBK";
         }
 
         return result;
     }
 
-    // Helper function: detect file encoding using uchardet and BOM detection (wrapper for compatibility)
-    static std::string detectFileEncoding(const fs::path &filepath)
-    {
-        std::vector<char> buffer = readFileAsBytes(filepath);
-        return detectFileEncodingFromBuffer(buffer);
-    }
-
     // Helper function: get base encoding (remove BOM suffix)
     static std::string getBaseEncoding(const std::string &encoding)
     {
@@ -338,17 +1500,33 @@ private:
         return encoding;
     }
 
+    // Helper function: get the encoding a source is read as; GBK is read as its superset GB18030 so nothing outside GBK is lost
+    static std::string getSourceEncoding(const std::string &encoding)
+    {
+        std::string base = getBaseEncoding(encoding);
+        return base == "GBK" ? "GB18030" : base;
+    }
+
     // Helper function: check if encoding should have BOM
     static bool shouldHaveBom(const std::string &encoding)
     {
         return encoding == "UTF-8-BOM";
     }
 
-    // Helper function: convert encoding using iconv
-    static bool convertEncoding(const std::vector<char> &input_data, const std::string &from_encoding, const std::string &to_encoding, std::string &output_data)
+    // Helper function: check if pure ASCII text is already valid, byte for byte, in an encoding
+    static bool isAsciiCompatible(const std::string &encoding)
+    {
+        std::string name = IconvCache::normalizeName(encoding);
+        return name == "UTF8" || name == "ASCII" || name == "USASCII" || name == "GBK" || name == "GB2312" || name == "GB18030" || name == "CP936" ||
+               name == "EUCCN" || name == "BIG5" || name == "EUCKR" || name.compare(0, 7, "ISO8859") == 0;
+    }
+
+    // Helper function: convert encoding using the context's cached iconv descriptors
+    static bool convertEncoding(ConverterContext &context, std::string_view input_data, const std::string &from_encoding,
+        const std::string &to_encoding, std::string &output_data)
     {
         // Get base encodings for iconv
-        std::string iconv_from = getBaseEncoding(from_encoding);
+        std::string iconv_from = getSourceEncoding(from_encoding);
         std::string iconv_to = getBaseEncoding(to_encoding);
 
         // Prepare input data (skip BOM if present in source)
@@ -362,51 +1540,73 @@ private:
             input_size -= 3;
         }
 
-        iconv_t cd = iconv_open(iconv_to.c_str(), iconv_from.c_str());
-        if (cd == (iconv_t)-1)
+        // Conversions between Unicode forms do not need iconv; ASCII input is valid UTF-8
+        UnicodeForm from_form = UnicodeForm::Utf8;
+        UnicodeForm to_form = UnicodeForm::Utf8;
+        if ((iconv_from == "ASCII" || unicodeFormFromName(iconv_from, from_form)) && unicodeFormFromName(iconv_to, to_form))
         {
-            return false;
+            return transcodeUnicode(std::string_view(input_ptr, input_size), from_form, to_form, output_data);
         }
 
-        char *in_buf = const_cast<char *>(input_ptr);
-        size_t in_bytes_left = input_size;
-
-        // Set a reasonable output buffer size
-        size_t out_buf_size = in_bytes_left * 2 + 100;
-        std::vector<char> out_buffer(out_buf_size);
-        char *out_buf = out_buffer.data();
-        size_t out_bytes_left = out_buf_size;
-
-        size_t result = iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
-        if (result == (size_t)-1)
+        // GB encodings to and from UTF-8 go through the native tables
+        if (iconv_to == "UTF-8")
         {
-            iconv_close(cd);
-            return false;
+            if (const GbCodec *codec = GbCodec::forEncoding(iconv_from))
+            {
+                return codec->decodeToUtf8(std::string_view(input_ptr, input_size), output_data);
+            }
+        }
+        else if (iconv_from == "UTF-8")
+        {
+            if (const GbCodec *codec = GbCodec::forEncoding(iconv_to))
+            {
+                return codec->encodeFromUtf8(std::string_view(input_ptr, input_size), output_data);
+            }
         }
 
-        output_data.assign(out_buffer.data(), out_buf_size - out_bytes_left);
-        iconv_close(cd);
-        return true;
-    }
-
-    // Helper function: write data to file
-    static bool writeFile(const fs::path &filepath, const std::string &content, const std::string &encoding = "UTF-8")
-    {
-        std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
-        if (!file.is_open())
+        iconv_t cd = context.iconvCache().acquire(iconv_from, iconv_to);
+        if (cd == (iconv_t)-1)
         {
             return false;
         }
 
-        // Add BOM if needed
-        if (shouldHaveBom(encoding))
+        char *in_buf = const_cast<char *>(input_ptr);
+        size_t in_bytes_left = input_size;
+
+        // Size the output for the common case and grow it on E2BIG, resuming where iconv stopped
+        const OutputSizing &sizing = context.outputSizing();
+        output_data.resize(sizing.initialCapacity(input_size, EncodingTraits::of(iconv_from), EncodingTraits::of(iconv_to)));
+        size_t produced = 0;
+        bool flushing = false;
+        while (true)
         {
-            const unsigned char bom[] = { 0xEF, 0xBB, 0xBF };
-            file.write(reinterpret_cast<const char *>(bom), 3);
+            char *out_buf = &output_data[0] + produced;
+            size_t out_bytes_left = output_data.size() - produced;
+
+            // A final call without input emits any closing shift sequence
+            size_t result = flushing ? iconv(cd, nullptr, nullptr, &out_buf, &out_bytes_left)
+                                     : iconv(cd, &in_buf, &in_bytes_left, &out_buf, &out_bytes_left);
+            int error = errno;
+            produced = output_data.size() - out_bytes_left;
+
+            if (result != (size_t)-1)
+            {
+                if (flushing)
+                {
+                    break;
+                }
+                flushing = true;
+                continue;
+            }
+            if (error != E2BIG)
+            {
+                output_data.clear();
+                return false;
+            }
+            output_data.resize(sizing.nextCapacity(output_data.size(), produced, input_size - in_bytes_left, in_bytes_left));
         }
 
-        file.write(content.c_str(), content.length());
-        file.close();
+        output_data.resize(produced);
         return true;
     }
 };
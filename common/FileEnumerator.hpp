@@ -0,0 +1,153 @@
+#pragma once
+
+#include "BoundedQueue.hpp"
+#include "DirectoryWalker.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+#if defined(__cpp_lib_generator)
+#include <generator>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @class FileEnumerator
+ * @brief Lazy sequence of the matching files under a set of directories.
+ *
+ * The directories are walked by a DirectoryWalker on a background thread while the caller pulls files with
+ * next(), so work on the first file can start as soon as it is found instead of after the whole tree has
+ * been listed. A bounded queue between the two keeps the walk at most a queue's worth of files ahead of
+ * the caller. progress() gives an estimated total that firms up as the walk proceeds.
+ *
+ * Destroying the enumerator before the end stops the walk.
+ */
+class FileEnumerator
+{
+public:
+    /**
+     * @brief Selects the files to enumerate; called from the walker threads, so it must be thread-safe.
+     */
+    using Matcher = std::function<bool(const fs::path &)>;
+
+    /**
+     * @brief Start walking the directories.
+     *
+     * @param roots Directories to walk recursively.
+     * @param matches Selects the files to enumerate.
+     * @param threads Threads listing directories; 0 uses DirectoryWalker::defaultThreadCount().
+     * @param ordered Whether files come out in DirectoryWalker's deterministic order.
+     * @param capacity Files found ahead of the caller at most.
+     */
+    FileEnumerator(std::vector<fs::path> roots, Matcher matches, size_t threads = 0, bool ordered = false, size_t capacity = 256)
+        : m_queue(capacity)
+    {
+        m_thread = std::thread([this, roots = std::move(roots), matches = std::move(matches), threads, ordered] {
+            try
+            {
+                DirectoryWalker(threads, ordered)
+                    .walk(
+                        roots,
+                        [this, &matches](const fs::directory_entry &entry) {
+                            if (!matches(entry.path()))
+                            {
+                                return true;
+                            }
+                            m_progress.filesMatched += 1;
+                            fs::path path = entry.path();
+                            return m_queue.push(path);
+                        },
+                        &m_stop, &m_progress);
+            }
+            catch (...)
+            {
+                m_error = std::current_exception();
+            }
+            m_queue.close();
+        });
+    }
+
+    FileEnumerator(const FileEnumerator &) = delete;
+    FileEnumerator &operator=(const FileEnumerator &) = delete;
+
+    ~FileEnumerator()
+    {
+        stop();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    /**
+     * @brief Wait for the next matching file.
+     *
+     * @return false once every file has been returned, or after stop().
+     * @throws std::filesystem::filesystem_error once the files found before a directory failed to list have been returned.
+     */
+    bool next(fs::path &path)
+    {
+        if (m_queue.pop(path))
+        {
+            return true;
+        }
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+        if (m_error)
+        {
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+        }
+        return false;
+    }
+
+    /**
+     * @brief End the walk; next() returns the files already queued, then false.
+     */
+    void stop()
+    {
+        m_stop = true;
+        m_queue.close();
+    }
+
+    /**
+     * @brief Walk counters; progress().estimatedTotal() estimates the number of files next() will return.
+     */
+    const ScanProgress &progress() const
+    {
+        return m_progress;
+    }
+
+private:
+    BoundedQueue<fs::path> m_queue;
+    ScanProgress m_progress;
+    std::atomic<bool> m_stop{ false };
+    std::exception_ptr m_error;
+    std::thread m_thread;
+};
+
+#if defined(__cpp_lib_generator)
+/**
+ * @brief The files of a FileEnumerator as a std::generator, for range-based for loops.
+ */
+inline std::generator<const fs::path &> enumerateFiles(std::vector<fs::path> roots, FileEnumerator::Matcher matches, size_t threads = 0, bool ordered = false)
+{
+    FileEnumerator files(std::move(roots), std::move(matches), threads, ordered);
+    fs::path path;
+    while (files.next(path))
+    {
+        co_yield path;
+    }
+}
+#endif
@@ -0,0 +1,470 @@
+#pragma once
+
+#include "AsciiScan.hpp"
+#include "IconvCache.hpp"
+#include "UnicodeTranscoder.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iconv.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @class GbCodec
+ * @brief Table-driven GB18030, GBK and GB2312 conversion to and from UTF-8.
+ *
+ * Two-byte codes are decoded through one 190-entry row per lead byte, and code points are encoded through
+ * 256-entry pages allocated only for the high bytes that have two-byte codes. The four-byte GB18030
+ * codes for the BMP are described by a short list of linear ranges, and the supplementary planes follow
+ * the fixed GB18030 formula. ASCII runs are copied in bulk.
+ *
+ * The tables are filled from the platform iconv the first time an encoding is used, so the mapping is
+ * exactly the one iconv would apply and there is no generated source to keep in sync. Building them
+ * takes a few milliseconds once per process; if iconv cannot provide them, forEncoding() returns
+ * nullptr and callers fall back to iconv.
+ */
+class GbCodec
+{
+public:
+    /**
+     * @brief Codec for a GB encoding name, or nullptr if the name is not handled natively.
+     *
+     * GB18030, GBK (CP936) and GB2312 (EUC-CN) are recognised. Each codec is built on first use and
+     * shared by all threads afterwards.
+     */
+    static const GbCodec *forEncoding(const std::string &encoding)
+    {
+        std::string name = IconvCache::normalizeName(encoding);
+        if (name == "GB18030")
+        {
+            static const GbCodec gb18030("GB18030", true);
+            return gb18030.m_ready ? &gb18030 : nullptr;
+        }
+        if (name == "GBK" || name == "CP936")
+        {
+            static const GbCodec gbk("GBK", false);
+            return gbk.m_ready ? &gbk : nullptr;
+        }
+        if (name == "GB2312" || name == "EUCCN")
+        {
+            static const GbCodec gb2312("GB2312", false);
+            return gb2312.m_ready ? &gb2312 : nullptr;
+        }
+        return nullptr;
+    }
+
+    GbCodec(const GbCodec &) = delete;
+    GbCodec &operator=(const GbCodec &) = delete;
+
+    /**
+     * @brief Decode GB bytes to UTF-8.
+     *
+     * @return false on an unmapped or truncated sequence; output is cleared in that case.
+     */
+    bool decodeToUtf8(std::string_view input, std::string &output) const
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(input.data());
+        const unsigned char *end = p + input.size();
+        output.resize(input.size() + input.size() / 2 + 16);
+        size_t produced = 0;
+
+        while (p < end)
+        {
+            size_t ascii = asciiPrefixLength(reinterpret_cast<const char *>(p), static_cast<size_t>(end - p));
+            reserve(output, produced, ascii);
+            std::memcpy(&output[produced], p, ascii);
+            produced += ascii;
+            p += ascii;
+
+            while (p < end && *p >= 0x80)
+            {
+                uint32_t cp;
+                if (!decodeOne(p, end, cp))
+                {
+                    output.clear();
+                    return false;
+                }
+                reserve(output, produced, 4);
+                unsigned char *out = reinterpret_cast<unsigned char *>(&output[produced]);
+                produced += static_cast<size_t>(unicode_detail::encode<UnicodeForm::Utf8>(out, cp) - out);
+            }
+        }
+
+        output.resize(produced);
+        return true;
+    }
+
+    /**
+     * @brief Encode UTF-8 to GB bytes.
+     *
+     * @return false on invalid UTF-8 or a character the encoding cannot represent; output is cleared in
+     * that case.
+     */
+    bool encodeFromUtf8(std::string_view input, std::string &output) const
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(input.data());
+        const unsigned char *end = p + input.size();
+        output.resize(input.size() + input.size() / 4 + 16);
+        size_t produced = 0;
+
+        while (p < end)
+        {
+            size_t ascii = asciiPrefixLength(reinterpret_cast<const char *>(p), static_cast<size_t>(end - p));
+            reserve(output, produced, ascii);
+            std::memcpy(&output[produced], p, ascii);
+            produced += ascii;
+            p += ascii;
+
+            while (p < end && *p >= 0x80)
+            {
+                uint32_t cp;
+                if (!unicode_detail::decode<UnicodeForm::Utf8>(p, end, cp))
+                {
+                    output.clear();
+                    return false;
+                }
+                reserve(output, produced, 4);
+                size_t written = encodeOne(cp, reinterpret_cast<unsigned char *>(&output[produced]));
+                if (written == kUnmapped)
+                {
+                    output.clear();
+                    return false;
+                }
+                produced += written;
+            }
+        }
+
+        output.resize(produced);
+        return true;
+    }
+
+private:
+    static constexpr unsigned kLeadCount = 0xFE - 0x81 + 1;
+    static constexpr unsigned kTrailCount = 0xFE - 0x40;  // 0x40-0xFE without 0x7F
+    static constexpr uint32_t kFourByteBmpCount = 39420;  // linear indices of 0x81308130-0x8431A439
+    static constexpr uint32_t kSupplementaryBase = 189000;  // linear index of 0x90308130, which is U+10000
+    static constexpr uint16_t kWide = 0xD800;  // decode entry whose code point is in m_wideDecode
+    static constexpr uint16_t kNoPage = 0xFFFF;
+    static constexpr size_t kUnmapped = static_cast<size_t>(-1);
+
+    struct Range
+    {
+        uint32_t linear;
+        uint32_t codepoint;
+        uint32_t length;
+    };
+
+    GbCodec(const char *name, bool four_byte)
+        : m_fourByte(four_byte)
+    {
+        std::fill(std::begin(m_singleDecode), std::end(m_singleDecode), uint16_t(0));
+        std::fill(std::begin(m_encodePage), std::end(m_encodePage), kNoPage);
+
+        iconv_t decoder = iconv_open("UTF-32LE", name);
+        iconv_t encoder = iconv_open(name, "UTF-32LE");
+        if (decoder != (iconv_t)-1 && encoder != (iconv_t)-1)
+        {
+            m_ready = buildDecodeTables(decoder) && buildEncodeTables(encoder);
+        }
+        if (decoder != (iconv_t)-1)
+        {
+            iconv_close(decoder);
+        }
+        if (encoder != (iconv_t)-1)
+        {
+            iconv_close(encoder);
+        }
+    }
+
+    // Helper function: convert one complete sequence with iconv; returns the number of bytes produced, kUnmapped on failure
+    static size_t convertOne(iconv_t cd, const void *input, size_t input_size, unsigned char *output, size_t output_size)
+    {
+        iconv(cd, nullptr, nullptr, nullptr, nullptr);
+        char *in_buf = static_cast<char *>(const_cast<void *>(input));
+        size_t in_left = input_size;
+        char *out_buf = reinterpret_cast<char *>(output);
+        size_t out_left = output_size;
+        if (iconv(cd, &in_buf, &in_left, &out_buf, &out_left) == (size_t)-1 || in_left != 0)
+        {
+            return kUnmapped;
+        }
+        return output_size - out_left;
+    }
+
+    static uint32_t decodedCodepoint(iconv_t decoder, const unsigned char *bytes, size_t size)
+    {
+        unsigned char out[8];
+        if (convertOne(decoder, bytes, size, out, sizeof(out)) != 4)
+        {
+            return 0;
+        }
+        return unicode_detail::loadUnit<UnicodeForm::Utf32LE>(out);
+    }
+
+    static uint32_t linearIndex(const unsigned char *bytes)
+    {
+        return (((bytes[0] - 0x81u) * 10 + (bytes[1] - 0x30u)) * 126 + (bytes[2] - 0x81u)) * 10 + (bytes[3] - 0x30u);
+    }
+
+    static void appendRange(std::vector<Range> &ranges, uint32_t linear, uint32_t codepoint)
+    {
+        if (!ranges.empty())
+        {
+            Range &last = ranges.back();
+            if (last.linear + last.length == linear && last.codepoint + last.length == codepoint)
+            {
+                ++last.length;
+                return;
+            }
+        }
+        ranges.push_back({ linear, codepoint, 1 });
+    }
+
+    bool buildDecodeTables(iconv_t decoder)
+    {
+        for (unsigned byte = 0x80; byte <= 0xFF; ++byte)
+        {
+            unsigned char single = static_cast<unsigned char>(byte);
+            uint32_t cp = decodedCodepoint(decoder, &single, 1);
+            if (cp > 0xFFFF)
+            {
+                return false;
+            }
+            m_singleDecode[byte - 0x80] = static_cast<uint16_t>(cp);
+        }
+
+        m_decode.assign(kLeadCount * kTrailCount, 0);
+        for (unsigned lead = 0x81; lead <= 0xFE; ++lead)
+        {
+            for (unsigned trail = 0x40; trail <= 0xFE; ++trail)
+            {
+                if (trail == 0x7F)
+                {
+                    continue;
+                }
+                const unsigned char bytes[2] = { static_cast<unsigned char>(lead), static_cast<unsigned char>(trail) };
+                uint32_t cp = decodedCodepoint(decoder, bytes, 2);
+                uint16_t &entry = m_decode[(lead - 0x81) * kTrailCount + trailIndex(static_cast<unsigned char>(trail))];
+                if (cp > 0xFFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                {
+                    entry = kWide;
+                    m_wideDecode.emplace_back(static_cast<uint16_t>((lead << 8) | trail), cp);
+                }
+                else
+                {
+                    entry = static_cast<uint16_t>(cp);
+                }
+            }
+        }
+
+        if (m_fourByte)
+        {
+            for (uint32_t linear = 0; linear < kFourByteBmpCount; ++linear)
+            {
+                const unsigned char bytes[4] = { static_cast<unsigned char>(0x81 + linear / 12600), static_cast<unsigned char>(0x30 + linear / 1260 % 10),
+                    static_cast<unsigned char>(0x81 + linear / 10 % 126), static_cast<unsigned char>(0x30 + linear % 10) };
+                uint32_t cp = decodedCodepoint(decoder, bytes, 4);
+                if (cp != 0)
+                {
+                    appendRange(m_decodeRanges, linear, cp);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool buildEncodeTables(iconv_t encoder)
+    {
+        auto encode = [&](uint32_t cp, unsigned char *out) {
+            unsigned char in[4];
+            unicode_detail::storeUnit<UnicodeForm::Utf32LE>(in, cp);
+            return convertOne(encoder, in, sizeof(in), out, 8);
+        };
+
+        unsigned char out[8];
+        for (uint32_t cp = 0x80; cp <= 0xFFFF; ++cp)
+        {
+            if (cp >= 0xD800 && cp <= 0xDFFF)
+            {
+                continue;
+            }
+            size_t size = encode(cp, out);
+            if (size == 1)
+            {
+                setEncode(cp, out[0]);
+            }
+            else if (size == 2)
+            {
+                setEncode(cp, static_cast<uint16_t>((out[0] << 8) | out[1]));
+            }
+            else if (size == 4 && m_fourByte)
+            {
+                appendRange(m_encodeRanges, linearIndex(out), cp);
+            }
+        }
+
+        for (const auto &wide : m_wideDecode)
+        {
+            if (wide.second > 0xFFFF && encode(wide.second, out) == 2)
+            {
+                m_wideEncode.emplace_back(wide.second, static_cast<uint16_t>((out[0] << 8) | out[1]));
+            }
+        }
+        std::sort(m_wideEncode.begin(), m_wideEncode.end());
+
+        // glibc drops the Unicode tag characters instead of rejecting them
+        m_dropsTags = !m_fourByte && encode(0xE0000, out) == 0;
+        return true;
+    }
+
+    void setEncode(uint32_t cp, uint16_t code)
+    {
+        uint16_t &page = m_encodePage[cp >> 8];
+        if (page == kNoPage)
+        {
+            page = static_cast<uint16_t>(m_encode.size() / 256);
+            m_encode.resize(m_encode.size() + 256, 0);
+        }
+        m_encode[page * 256u + (cp & 0xFF)] = code;
+    }
+
+    static unsigned trailIndex(unsigned char trail)
+    {
+        return trail < 0x7F ? trail - 0x40u : trail - 0x41u;
+    }
+
+    // Helper function: grow output so that at least needed more bytes fit after produced
+    static void reserve(std::string &output, size_t produced, size_t needed)
+    {
+        if (output.size() - produced < needed)
+        {
+            output.resize(std::max(output.size() + output.size() / 2, produced + needed));
+        }
+    }
+
+    bool decodeOne(const unsigned char *&p, const unsigned char *end, uint32_t &cp) const
+    {
+        unsigned char lead = p[0];
+        if (lead == 0x80 || lead == 0xFF || end - p < 2)
+        {
+            cp = m_singleDecode[lead - 0x80];
+            p += 1;
+            return cp != 0;
+        }
+
+        unsigned char trail = p[1];
+        if (trail >= 0x40 && trail <= 0xFE && trail != 0x7F)
+        {
+            uint16_t entry = m_decode[(lead - 0x81) * kTrailCount + trailIndex(trail)];
+            if (entry == kWide)
+            {
+                uint16_t code = static_cast<uint16_t>((lead << 8) | trail);
+                auto it = std::find_if(m_wideDecode.begin(), m_wideDecode.end(), [code](const auto &wide) {
+                    return wide.first == code;
+                });
+                cp = it->second;
+            }
+            else
+            {
+                cp = entry;
+            }
+            p += 2;
+            return cp != 0;
+        }
+
+        if (!m_fourByte || trail < 0x30 || trail > 0x39 || end - p < 4 || p[2] < 0x81 || p[2] > 0xFE || p[3] < 0x30 || p[3] > 0x39)
+        {
+            cp = m_singleDecode[lead - 0x80];
+            p += 1;
+            return cp != 0;
+        }
+
+        uint32_t linear = linearIndex(p);
+        p += 4;
+        if (linear >= kSupplementaryBase)
+        {
+            cp = linear - kSupplementaryBase + 0x10000;
+            return cp <= 0x10FFFF;
+        }
+        auto it = std::upper_bound(m_decodeRanges.begin(), m_decodeRanges.end(), linear, [](uint32_t value, const Range &range) {
+            return value < range.linear;
+        });
+        if (it == m_decodeRanges.begin() || linear - (it - 1)->linear >= (it - 1)->length)
+        {
+            return false;
+        }
+        --it;
+        cp = it->codepoint + (linear - it->linear);
+        return true;
+    }
+
+    size_t encodeOne(uint32_t cp, unsigned char *out) const
+    {
+        if (cp <= 0xFFFF)
+        {
+            uint16_t page = m_encodePage[cp >> 8];
+            uint16_t code = page == kNoPage ? 0 : m_encode[page * 256u + (cp & 0xFF)];
+            if (code >= 0x100)
+            {
+                out[0] = static_cast<unsigned char>(code >> 8);
+                out[1] = static_cast<unsigned char>(code);
+                return 2;
+            }
+            if (code != 0)
+            {
+                out[0] = static_cast<unsigned char>(code);
+                return 1;
+            }
+
+            auto it = std::upper_bound(m_encodeRanges.begin(), m_encodeRanges.end(), cp, [](uint32_t value, const Range &range) {
+                return value < range.codepoint;
+            });
+            if (it == m_encodeRanges.begin() || cp - (it - 1)->codepoint >= (it - 1)->length)
+            {
+                return kUnmapped;
+            }
+            --it;
+            return writeFourByte(it->linear + (cp - it->codepoint), out);
+        }
+
+        auto wide = std::lower_bound(m_wideEncode.begin(), m_wideEncode.end(), std::make_pair(cp, uint16_t(0)));
+        if (wide != m_wideEncode.end() && wide->first == cp)
+        {
+            out[0] = static_cast<unsigned char>(wide->second >> 8);
+            out[1] = static_cast<unsigned char>(wide->second);
+            return 2;
+        }
+        if (m_dropsTags && cp >= 0xE0000 && cp <= 0xE007F)
+        {
+            return 0;
+        }
+        return m_fourByte ? writeFourByte(cp - 0x10000 + kSupplementaryBase, out) : kUnmapped;
+    }
+
+    static size_t writeFourByte(uint32_t linear, unsigned char *out)
+    {
+        out[3] = static_cast<unsigned char>(0x30 + linear % 10);
+        linear /= 10;
+        out[2] = static_cast<unsigned char>(0x81 + linear % 126);
+        linear /= 126;
+        out[1] = static_cast<unsigned char>(0x30 + linear % 10);
+        out[0] = static_cast<unsigned char>(0x81 + linear / 10);
+        return 4;
+    }
+
+    bool m_ready = false;
+    bool m_fourByte;
+    bool m_dropsTags = false;
+    uint16_t m_singleDecode[128];                             ///< Bytes 0x80-0xFF that stand alone, 0 if none
+    std::vector<uint16_t> m_decode;                           ///< One row of kTrailCount code points per lead byte
+    std::vector<std::pair<uint16_t, uint32_t>> m_wideDecode;  ///< Two-byte codes that map outside the BMP
+    std::vector<Range> m_decodeRanges;                        ///< Four-byte BMP codes, sorted by linear index
+    uint16_t m_encodePage[256];                               ///< Page of m_encode for each high byte of a BMP code point
+    std::vector<uint16_t> m_encode;                           ///< One- or two-byte code per code point, 0 if none
+    std::vector<std::pair<uint32_t, uint16_t>> m_wideEncode;  ///< Supplementary code points with two-byte codes
+    std::vector<Range> m_encodeRanges;                        ///< Four-byte BMP codes, sorted by code point
+};
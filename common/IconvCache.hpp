@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <iconv.h>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class IconvCache
+ * @brief Keeps iconv conversion descriptors open between files.
+ *
+ * iconv_open has to look up and initialise both charsets, which costs far more than converting a typical
+ * source file. The cache opens each (source, target) pair once and hands the same descriptor back on later
+ * requests after resetting its shift state. A cache is owned by a single thread and is not thread-safe.
+ */
+class IconvCache
+{
+public:
+    /**
+     * @struct Stats
+     * @brief Descriptor reuse counters
+     */
+    struct Stats
+    {
+        uint64_t hits = 0;    ///< Requests served by an already open descriptor
+        uint64_t misses = 0;  ///< Requests that had to call iconv_open
+    };
+
+    IconvCache() = default;
+    IconvCache(const IconvCache &) = delete;
+    IconvCache &operator=(const IconvCache &) = delete;
+
+    ~IconvCache()
+    {
+        clear();
+    }
+
+    /**
+     * @brief Get a descriptor converting from one encoding to another.
+     *
+     * The returned descriptor is owned by the cache and is already reset to its initial shift state.
+     *
+     * @param from_encoding Source encoding name as understood by iconv.
+     * @param to_encoding Target encoding name as understood by iconv.
+     * @return iconv_t Open descriptor, or (iconv_t)-1 if iconv does not support the pair.
+     */
+    iconv_t acquire(const std::string &from_encoding, const std::string &to_encoding)
+    {
+        std::string key = normalizeName(from_encoding) + '\n' + normalizeName(to_encoding);
+        auto it = m_handles.find(key);
+        if (it != m_handles.end())
+        {
+            ++m_stats.hits;
+            iconv(it->second, nullptr, nullptr, nullptr, nullptr);
+            return it->second;
+        }
+
+        ++m_stats.misses;
+        iconv_t cd = iconv_open(to_encoding.c_str(), from_encoding.c_str());
+        if (cd != (iconv_t)-1)
+        {
+            m_handles.emplace(std::move(key), cd);
+        }
+        return cd;
+    }
+
+    /**
+     * @brief Close every cached descriptor. Counters are kept.
+     */
+    void clear()
+    {
+        for (auto &entry : m_handles)
+        {
+            iconv_close(entry.second);
+        }
+        m_handles.clear();
+    }
+
+    /**
+     * @brief Number of descriptors currently held open.
+     */
+    size_t size() const
+    {
+        return m_handles.size();
+    }
+
+    const Stats &stats() const
+    {
+        return m_stats;
+    }
+
+    /**
+     * @brief Normalize an encoding name so that spelling variants share a cache slot.
+     *
+     * "utf8", "UTF-8" and " utf_8 " all map to "UTF8".
+     */
+    static std::string normalizeName(const std::string &encoding)
+    {
+        std::string name;
+        name.reserve(encoding.size());
+        for (char c : encoding)
+        {
+            if (c == '-' || c == '_' || std::isspace(static_cast<unsigned char>(c)))
+            {
+                continue;
+            }
+            name += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        return name;
+    }
+
+private:
+    std::unordered_map<std::string, iconv_t> m_handles;
+    Stats m_stats;
+};
@@ -0,0 +1,477 @@
+#pragma once
+
+#include "AtomicWriter.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+    #include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @struct FileStamp
+ * @brief File metadata that changes whenever the file's contents are replaced
+ */
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;   ///< Last write time in the file system clock's native ticks
+    uint64_t inode = 0;  ///< Inode number on POSIX; 0 on Windows
+
+    bool operator==(const FileStamp &other) const
+    {
+        return size == other.size && mtime == other.mtime && inode == other.inode;
+    }
+
+    bool operator!=(const FileStamp &other) const
+    {
+        return !(*this == other);
+    }
+
+    /**
+     * @brief Read the stamp of a file without opening it.
+     *
+     * @return false if the file cannot be examined.
+     */
+    static bool read(const fs::path &path, FileStamp &stamp)
+    {
+#ifdef _WIN32
+        std::error_code ec;
+        uintmax_t size = fs::file_size(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+        fs::file_time_type mtime = fs::last_write_time(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+        stamp.size = size;
+        stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+        stamp.inode = 0;
+#else
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        stamp.size = static_cast<uint64_t>(st.st_size);
+    #ifdef __APPLE__
+        stamp.mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    #else
+        stamp.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    #endif
+        stamp.inode = static_cast<uint64_t>(st.st_ino);
+#endif
+        return true;
+    }
+};
+
+/**
+ * @struct ManifestEntry
+ * @brief What the previous run found out about one file
+ */
+struct ManifestEntry
+{
+    FileStamp stamp;
+    std::string encoding;  ///< Detected source encoding, possibly empty
+    uint8_t outcome = 0;   ///< Caller-defined result code, e.g. a ConversionResult
+};
+
+/**
+ * @class Manifest
+ * @brief Record of the files handled by the previous run, used to skip files that have not changed since.
+ *
+ * The manifest file is memory-mapped when the Manifest is constructed and searched in place: records are
+ * fixed-size and sorted by path, so a lookup is a binary search over the mapping and loading costs no
+ * parsing, however many files the tree holds. Lookups may run on several threads at once.
+ *
+ * Entries for the current run are collected with record() and keep(), and save() replaces the manifest
+ * file atomically (write a temporary file, then rename it over the old one), so an interrupted run leaves
+ * the previous manifest intact. Files not recorded or kept during the run are dropped from the new
+ * manifest, which keeps deleted files from accumulating. A manifest written for a different target
+ * encoding, in a different format version or with inconsistent sizes is ignored.
+ *
+ * File layout, in native byte order:
+ * - Header
+ * - Record[recordCount], sorted by path bytes
+ * - EncodingRef[encodingCount]
+ * - string data: the target encoding, then encoding names and paths referenced by offset
+ *
+ * Paths are stored as the bytes of fs::path::native(), so they round-trip exactly on every platform.
+ */
+class Manifest
+{
+public:
+    Manifest() = default;
+
+    /**
+     * @brief Load the manifest file if it exists and matches the target encoding.
+     *
+     * @param file Manifest file; it need not exist yet.
+     * @param target_encoding Target encoding of this run.
+     */
+    Manifest(fs::path file, std::string target_encoding)
+        : m_file(std::move(file))
+        , m_targetEncoding(std::move(target_encoding))
+    {
+        std::error_code ec;
+        if (m_file.empty() || !fs::is_regular_file(m_file, ec))
+        {
+            return;
+        }
+        try
+        {
+            m_mapping = MappedFile(m_file, 0);
+        }
+        catch (const std::exception &)
+        {
+            return;
+        }
+        if (!parse())
+        {
+            m_mapping.close();
+            m_recordCount = 0;
+        }
+    }
+
+    Manifest(const Manifest &) = delete;
+    Manifest &operator=(const Manifest &) = delete;
+
+    const fs::path &file() const
+    {
+        return m_file;
+    }
+
+    /**
+     * @brief Number of entries loaded from the manifest file.
+     */
+    size_t loadedCount() const
+    {
+        return m_recordCount;
+    }
+
+    /**
+     * @brief Look up the previous entry of a file whose stamp is unchanged.
+     *
+     * @return The entry, or nothing if the file is unknown or has changed.
+     */
+    std::optional<ManifestEntry> find(const fs::path &path, const FileStamp &stamp) const
+    {
+        std::string_view key = keyOf(path);
+        size_t low = 0;
+        size_t high = m_recordCount;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            Record record = recordAt(middle);
+            if (!isValid(record))
+            {
+                return std::nullopt;
+            }
+            int order = pathOf(record).compare(key);
+            if (order == 0)
+            {
+                FileStamp previous{ record.size, record.mtime, record.inode };
+                if (previous != stamp)
+                {
+                    return std::nullopt;
+                }
+                return ManifestEntry{ previous, std::string(encodingOf(record)), record.outcome };
+            }
+            if (order < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Add a file handled in this run to the next manifest.
+     */
+    void record(const fs::path &path, const ManifestEntry &entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.emplace_back(std::string(keyOf(path)), entry);
+    }
+
+    /**
+     * @brief Carry an unchanged file's entry, as returned by find(), over to the next manifest.
+     */
+    void keep(const fs::path &path, const ManifestEntry &entry)
+    {
+        record(path, entry);
+        ++m_kept;
+    }
+
+    /**
+     * @brief Number of entries carried over with keep() in this run.
+     */
+    size_t keptCount() const
+    {
+        return m_kept.load();
+    }
+
+    /**
+     * @brief Atomically replace the manifest file with the entries of this run.
+     *
+     * The loaded manifest is released first, so find() returns nothing afterwards.
+     *
+     * @throws std::runtime_error if the manifest cannot be written.
+     */
+    void save()
+    {
+        std::vector<std::pair<std::string, ManifestEntry>> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            entries.swap(m_pending);
+        }
+        // Sort by path; for a path recorded twice the later entry wins
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+        std::vector<std::pair<std::string, ManifestEntry>> unique;
+        unique.reserve(entries.size());
+        for (auto &entry : entries)
+        {
+            if (!unique.empty() && unique.back().first == entry.first)
+            {
+                unique.back() = std::move(entry);
+            }
+            else
+            {
+                unique.push_back(std::move(entry));
+            }
+        }
+
+        // Lay out the string data: target encoding, encoding names, paths
+        std::string strings = m_targetEncoding;
+        std::map<std::string, uint16_t> encoding_index;
+        std::vector<EncodingRef> encodings;
+        std::vector<Record> records;
+        records.reserve(unique.size());
+        for (const auto &[key, entry] : unique)
+        {
+            auto found = encoding_index.find(entry.encoding);
+            if (found == encoding_index.end())
+            {
+                if (encodings.size() == UINT16_MAX)
+                {
+                    continue;
+                }
+                found = encoding_index.emplace(entry.encoding, static_cast<uint16_t>(encodings.size())).first;
+                encodings.push_back(EncodingRef{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(entry.encoding.size()) });
+                strings += entry.encoding;
+            }
+
+            Record record{};
+            record.size = entry.stamp.size;
+            record.mtime = entry.stamp.mtime;
+            record.inode = entry.stamp.inode;
+            record.pathOffset = strings.size();
+            record.pathLength = static_cast<uint32_t>(key.size());
+            record.encodingIndex = found->second;
+            record.outcome = entry.outcome;
+            records.push_back(record);
+            strings += key;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.version = kVersion;
+        header.recordCount = records.size();
+        header.encodingCount = static_cast<uint32_t>(encodings.size());
+        header.targetLength = static_cast<uint32_t>(m_targetEncoding.size());
+        header.stringsSize = strings.size();
+
+        fs::path temp_path = AtomicWriter::createTemporary(m_file);
+        if (temp_path.empty())
+        {
+            throw std::runtime_error("Could not create a temporary file for manifest: " + m_file.string());
+        }
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+            out.write(reinterpret_cast<const char *>(encodings.data()), static_cast<std::streamsize>(encodings.size() * sizeof(EncodingRef)));
+            out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+            out.close();
+            if (!out)
+            {
+                std::error_code ec;
+                fs::remove(temp_path, ec);
+                throw std::runtime_error("Could not write manifest: " + temp_path.string());
+            }
+        }
+
+        // Windows cannot replace a file that is still mapped
+        m_mapping.close();
+        m_recordCount = 0;
+
+        if (!AtomicWriter::replace(temp_path, m_file))
+        {
+            throw std::runtime_error("Could not replace manifest: " + m_file.string());
+        }
+    }
+
+private:
+    static constexpr char kMagic[4] = { 'E', 'C', 'M', 'F' };
+    static constexpr uint32_t kVersion = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t recordCount;
+        uint32_t encodingCount;
+        uint32_t targetLength;
+        uint64_t stringsSize;
+    };
+
+    struct Record
+    {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t inode;
+        uint64_t pathOffset;     ///< Into the string data
+        uint32_t pathLength;
+        uint16_t encodingIndex;  ///< Into the EncodingRef table
+        uint8_t outcome;
+        uint8_t reserved;
+    };
+
+    struct EncodingRef
+    {
+        uint32_t offset;  ///< Into the string data
+        uint32_t length;
+    };
+
+    static_assert(sizeof(Header) == 32 && sizeof(Record) == 40 && sizeof(EncodingRef) == 8, "manifest layout must not depend on padding");
+
+    static std::string_view keyOf(const fs::path &path)
+    {
+        const fs::path::string_type &native = path.native();
+        return std::string_view(reinterpret_cast<const char *>(native.data()), native.size() * sizeof(fs::path::value_type));
+    }
+
+    // Helper function: validate the header and table sizes against the mapped file
+    bool parse()
+    {
+        std::string_view bytes = m_mapping.bytes();
+        Header header;
+        if (bytes.size() < sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+        {
+            return false;
+        }
+
+        uint64_t available = bytes.size() - sizeof(header);
+        if (header.recordCount > available / sizeof(Record))
+        {
+            return false;
+        }
+        available -= header.recordCount * sizeof(Record);
+        if (header.encodingCount > available / sizeof(EncodingRef))
+        {
+            return false;
+        }
+        available -= uint64_t(header.encodingCount) * sizeof(EncodingRef);
+        if (header.stringsSize != available || header.targetLength > header.stringsSize)
+        {
+            return false;
+        }
+
+        m_records = bytes.data() + sizeof(header);
+        m_encodings = m_records + header.recordCount * sizeof(Record);
+        m_strings = std::string_view(m_encodings + header.encodingCount * sizeof(EncodingRef), header.stringsSize);
+        m_encodingCount = header.encodingCount;
+        if (m_strings.substr(0, header.targetLength) != m_targetEncoding)
+        {
+            return false;
+        }
+
+        // The encoding table is small enough to check up front; records are checked as lookups reach them
+        for (uint32_t i = 0; i < m_encodingCount; ++i)
+        {
+            EncodingRef ref = encodingAt(i);
+            if (ref.offset > m_strings.size() || ref.length > m_strings.size() - ref.offset)
+            {
+                return false;
+            }
+        }
+        m_recordCount = header.recordCount;
+        return true;
+    }
+
+    bool isValid(const Record &record) const
+    {
+        return record.pathOffset <= m_strings.size() && record.pathLength <= m_strings.size() - record.pathOffset &&
+               record.encodingIndex < m_encodingCount;
+    }
+
+    Record recordAt(size_t index) const
+    {
+        Record record;
+        std::memcpy(&record, m_records + index * sizeof(Record), sizeof(Record));
+        return record;
+    }
+
+    EncodingRef encodingAt(size_t index) const
+    {
+        EncodingRef ref;
+        std::memcpy(&ref, m_encodings + index * sizeof(EncodingRef), sizeof(EncodingRef));
+        return ref;
+    }
+
+    std::string_view pathOf(const Record &record) const
+    {
+        return m_strings.substr(record.pathOffset, record.pathLength);
+    }
+
+    std::string_view encodingOf(const Record &record) const
+    {
+        EncodingRef ref = encodingAt(record.encodingIndex);
+        return m_strings.substr(ref.offset, ref.length);
+    }
+
+    fs::path m_file;
+    std::string m_targetEncoding;
+
+    MappedFile m_mapping;
+    const char *m_records = nullptr;
+    const char *m_encodings = nullptr;
+    std::string_view m_strings;
+    size_t m_recordCount = 0;
+    uint32_t m_encodingCount = 0;
+
+    std::mutex m_mutex;
+    std::vector<std::pair<std::string, ManifestEntry>> m_pending;
+    std::atomic<size_t> m_kept{ 0 };
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * @class MappedFile
+ * @brief Read-only view of a whole file, memory-mapped when it is large enough to pay off.
+ *
+ * Files of at least map_threshold bytes are mapped (with MADV_SEQUENTIAL on POSIX) so detection and
+ * conversion run directly over the page cache. Smaller files are read with a single read() into an
+ * uninitialised buffer, because setting up a mapping costs more than copying a few pages. Either way the
+ * bytes are exposed as a std::string_view. Call close() before rewriting the file: Windows refuses to
+ * truncate a mapped file and POSIX would fault on access to truncated pages.
+ */
+class MappedFile
+{
+public:
+    static constexpr size_t kDefaultMapThreshold = 64 * 1024;
+
+    MappedFile() = default;
+
+    /**
+     * @brief Open and map or read a file.
+     *
+     * @param filepath File to open.
+     * @param map_threshold Files at least this large are mapped; smaller ones are read.
+     * @throws std::runtime_error if the file cannot be opened or read.
+     */
+    explicit MappedFile(const std::filesystem::path &filepath, size_t map_threshold = kDefaultMapThreshold)
+    {
+        open(filepath, map_threshold);
+    }
+
+    /**
+     * @brief Take over bytes already read into memory, e.g. by BatchIo.
+     */
+    MappedFile(std::unique_ptr<char[]> buffer, size_t size)
+        : m_buffer(std::move(buffer))
+        , m_data(m_buffer.get())
+        , m_size(size)
+    {
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+    {
+        swap(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    std::string_view bytes() const
+    {
+        return std::string_view(m_data, m_size);
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    bool isMapped() const
+    {
+        return m_mapped;
+    }
+
+    /**
+     * @brief Release the mapping or buffer. The view returned by bytes() becomes invalid.
+     */
+    void close()
+    {
+        if (m_mapped)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_data);
+#else
+            munmap(const_cast<char *>(m_data), m_size);
+#endif
+        }
+        m_buffer.reset();
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
+    }
+
+private:
+    void swap(MappedFile &other) noexcept
+    {
+        std::swap(m_buffer, other.m_buffer);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_mapped, other.m_mapped);
+    }
+
+#ifdef _WIN32
+    void open(const std::filesystem::path &filepath, size_t map_threshold)
+    {
+        HANDLE file = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("Could not open file.");
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Could not read file size.");
+        }
+        size_t size = static_cast<size_t>(file_size.QuadPart);
+
+        if (size != 0 && size >= map_threshold)
+        {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (mapping)
+            {
+                CloseHandle(mapping);  // the view keeps the mapping alive
+            }
+            if (view)
+            {
+                CloseHandle(file);
+                m_data = static_cast<const char *>(view);
+                m_size = size;
+                m_mapped = true;
+                return;
+            }
+        }
+
+        readAll(file, size);
+        CloseHandle(file);
+    }
+
+    void readAll(HANDLE file, size_t size)
+    {
+        m_buffer.reset(new char[size ? size : 1]);
+        size_t total = 0;
+        while (total < size)
+        {
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+            DWORD got = 0;
+            if (!ReadFile(file, m_buffer.get() + total, chunk, &got, nullptr))
+            {
+                CloseHandle(file);
+                m_buffer.reset();
+                throw std::runtime_error("Could not read file.");
+            }
+            if (got == 0)
+            {
+                break;
+            }
+            total += got;
+        }
+        m_data = m_buffer.get();
+        m_size = total;
+    }
+#else
+    void open(const std::filesystem::path &filepath, size_t map_threshold)
+    {
+        int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open file.");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not read file size.");
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+
+        if (size != 0 && size >= map_threshold)
+        {
+            void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                madvise(view, size, MADV_SEQUENTIAL);
+                ::close(fd);
+                m_data = static_cast<const char *>(view);
+                m_size = size;
+                m_mapped = true;
+                return;
+            }
+        }
+
+        readAll(fd, size);
+        ::close(fd);
+    }
+
+    void readAll(int fd, size_t size)
+    {
+        m_buffer.reset(new char[size ? size : 1]);
+        size_t total = 0;
+        while (total < size)
+        {
+            ssize_t got = ::read(fd, m_buffer.get() + total, size - total);
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got < 0)
+            {
+                ::close(fd);
+                m_buffer.reset();
+                throw std::runtime_error("Could not read file.");
+            }
+            if (got == 0)
+            {
+                break;
+            }
+            total += static_cast<size_t>(got);
+        }
+        m_data = m_buffer.get();
+        m_size = total;
+    }
+#endif
+
+    std::unique_ptr<char[]> m_buffer;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+/**
+ * @class MpscQueue
+ * @brief Unbounded lock-free queue with many producers and a single consumer.
+ *
+ * This is Dmitry Vyukov's intrusive MPSC queue: a singly linked list of nodes where a push is one atomic
+ * exchange of the head plus one store linking the previous node, so producers never wait for each other or
+ * for the consumer. The consumer owns the tail and pops without atomic read-modify-write operations. A push
+ * in progress, between the exchange and the link, briefly hides the items pushed after it from the
+ * consumer; tryPop() then reports an empty queue and the items appear once the link is stored.
+ *
+ * push() may be called from any thread; tryPop() and empty() only from one consumer thread at a time.
+ * T must be movable; it need not be default constructible.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : m_head(new Node())
+    {
+        m_tail = m_head.load();
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    ~MpscQueue()
+    {
+        while (tryPop())
+        {
+        }
+        delete m_tail;
+    }
+
+    /**
+     * @brief Append an item; never blocks.
+     */
+    void push(T value)
+    {
+        Node *node = new Node();
+        node->value.emplace(std::move(value));
+        Node *previous = m_head.exchange(node);
+        // Sequentially consistent, so that a consumer going to sleep after finding the queue empty cannot miss it
+        previous->next.store(node);
+    }
+
+    /**
+     * @brief Remove the oldest item if there is one; consumer only.
+     */
+    std::optional<T> tryPop()
+    {
+        Node *next = m_tail->next.load();
+        if (!next)
+        {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(next->value));
+        next->value.reset();
+        delete m_tail;
+        m_tail = next;  // next becomes the empty node at the tail
+        return value;
+    }
+
+    /**
+     * @brief Whether tryPop() would find nothing right now; consumer only.
+     */
+    bool empty() const
+    {
+        return m_tail->next.load() == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next{ nullptr };
+        std::optional<T> value;
+    };
+
+    std::atomic<Node *> m_head;  ///< Most recently pushed node; exchanged by producers
+    Node *m_tail;                ///< Node before the oldest item; owned by the consumer
+};
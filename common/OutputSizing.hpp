@@ -0,0 +1,103 @@
+#pragma once
+
+#include "IconvCache.hpp"
+
+#include <algorithm>
+#include <string>
+
+/**
+ * @struct EncodingTraits
+ * @brief Byte widths of characters in an encoding, used to bound conversion output size
+ */
+struct EncodingTraits
+{
+    unsigned asciiBytes;     ///< Bytes used for a 7-bit ASCII character
+    unsigned minOtherBytes;  ///< Fewest bytes used for any non-ASCII character
+    unsigned maxBytes;       ///< Most bytes used for any character
+
+    /**
+     * @brief Look up traits by encoding name; unknown encodings get conservative values.
+     */
+    static EncodingTraits of(const std::string &encoding)
+    {
+        std::string name = IconvCache::normalizeName(encoding);
+        if (name == "UTF8" || name == "UTF8BOM")
+            return { 1, 2, 4 };
+        if (name.compare(0, 5, "UTF16") == 0 || name == "UCS2" || name == "UCS2LE" || name == "UCS2BE")
+            return { 2, 2, 4 };
+        if (name.compare(0, 5, "UTF32") == 0 || name.compare(0, 4, "UCS4") == 0)
+            return { 4, 4, 4 };
+        if (name == "GBK" || name == "GB2312" || name == "CP936" || name == "EUCCN" || name == "BIG5" || name == "CP950" || name == "EUCKR" ||
+            name == "CP949" || name == "SHIFTJIS" || name == "SJIS" || name == "CP932")
+            return { 1, 2, 2 };
+        if (name == "GB18030")
+            return { 1, 2, 4 };
+        if (name == "EUCJP")
+            return { 1, 2, 3 };
+        if (name == "ASCII" || name == "USASCII" || name.compare(0, 7, "ISO8859") == 0 || name.compare(0, 7, "WINDOWS") == 0 ||
+            name.compare(0, 4, "KOI8") == 0 || name.compare(0, 2, "CP") == 0)
+            return { 1, 1, 1 };
+        return { 1, 1, 4 };
+    }
+};
+
+/**
+ * @struct OutputSizing
+ * @brief Output buffer policy for one-shot iconv conversions.
+ *
+ * The first buffer assumes the input is mostly ASCII, which is exact for typical source files, plus a
+ * small slack. When iconv reports E2BIG the buffer grows geometrically, or to the size extrapolated from
+ * the output produced so far if that is larger, and conversion resumes where it stopped. The worst-case
+ * expansion of the encoding pair caps the first buffer so that it is never larger than needed.
+ */
+struct OutputSizing
+{
+    double growthFactor = 1.5;  ///< Minimum growth on each E2BIG
+    size_t slackDivisor = 8;    ///< First buffer gets input / slackDivisor extra bytes
+    size_t padding = 64;        ///< Extra bytes for BOMs and shift sequences
+
+    /**
+     * @brief Upper bound on output bytes per input byte for an encoding pair.
+     */
+    static double worstCaseFactor(const EncodingTraits &from, const EncodingTraits &to)
+    {
+        double ascii = static_cast<double>(to.asciiBytes) / from.asciiBytes;
+        double other = static_cast<double>(to.maxBytes) / from.minOtherBytes;
+        return std::max(ascii, other);
+    }
+
+    /**
+     * @brief Size of the first output buffer for converting input_size bytes.
+     */
+    size_t initialCapacity(size_t input_size, const EncodingTraits &from, const EncodingTraits &to) const
+    {
+        size_t ascii_estimate = input_size / from.asciiBytes * to.asciiBytes;
+        size_t slack = slackDivisor ? input_size / slackDivisor : 0;
+        size_t worst_case = static_cast<size_t>(static_cast<double>(input_size) * worstCaseFactor(from, to));
+        return std::min(ascii_estimate + slack, worst_case) + padding;
+    }
+
+    /**
+     * @brief Size of the next output buffer after iconv ran out of space.
+     *
+     * @param current Current buffer size.
+     * @param produced Output bytes written so far.
+     * @param consumed Input bytes converted so far.
+     * @param remaining Input bytes still to convert.
+     */
+    size_t nextCapacity(size_t current, size_t produced, size_t consumed, size_t remaining) const
+    {
+        size_t geometric = static_cast<size_t>(static_cast<double>(current) * std::max(growthFactor, 1.1));
+        size_t extrapolated = produced + padding;
+        if (consumed != 0)
+        {
+            double ratio = static_cast<double>(produced) / static_cast<double>(consumed);
+            extrapolated += static_cast<size_t>(static_cast<double>(remaining) * ratio * 1.125);
+        }
+        else
+        {
+            extrapolated += remaining * 4;
+        }
+        return std::max({ geometric, extrapolated, current + padding });
+    }
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * @class PatternMatcher
+ * @brief File name filter compiled once from a list of extensions and globs.
+ *
+ * Each pattern is sorted into the cheapest structure that can answer it:
+ * - a plain extension such as ".txt" goes into a hash set, looked up with the file name's last extension
+ *   (as fs::path::extension() defines it);
+ * - a suffix glob such as "*.txt" or "*.tar.gz", and a multi-part extension such as ".tar.gz", goes into a
+ *   trie of reversed suffixes, walked once from the end of the file name;
+ * - a name without wildcards such as "Makefile" goes into a hash set of whole names;
+ * - anything else ("*" and "?" elsewhere in the pattern) is matched as a glob, one pattern at a time.
+ *
+ * Matching works on string views and does not allocate. Case-insensitive matching folds ASCII letters only.
+ */
+class PatternMatcher
+{
+public:
+    PatternMatcher() = default;
+
+    /**
+     * @param patterns Extensions (".txt"), suffix globs ("*.txt"), other globs ("test_*.c") or whole file names.
+     * @param ignore_case Whether ASCII letters match regardless of case.
+     */
+    explicit PatternMatcher(const std::vector<std::string> &patterns, bool ignore_case = false)
+        : m_ignoreCase(ignore_case)
+    {
+        for (const std::string &raw : patterns)
+        {
+            if (raw.empty())
+            {
+                continue;
+            }
+            std::string pattern = raw;
+            for (char &c : pattern)
+            {
+                c = static_cast<char>(fold(static_cast<unsigned char>(c)));
+            }
+
+            size_t wildcard = pattern.find_first_of("*?");
+            if (wildcard == std::string::npos)
+            {
+                if (pattern[0] == '.' && pattern.find('.', 1) == std::string::npos && pattern.size() <= kMaxExtension)
+                {
+                    m_extensionStorage.push_back(std::move(pattern));
+                }
+                else if (pattern[0] == '.')
+                {
+                    addSuffix(pattern);
+                }
+                else
+                {
+                    m_nameStorage.push_back(std::move(pattern));
+                }
+            }
+            else if (pattern[0] == '*' && pattern.find_first_of("*?", 1) == std::string::npos)
+            {
+                addSuffix(std::string_view(pattern).substr(1));
+            }
+            else
+            {
+                m_globs.push_back(std::move(pattern));
+            }
+        }
+
+        // The sets hold views into the storage vectors, which no longer change
+        m_extensions.insert(m_extensionStorage.begin(), m_extensionStorage.end());
+        m_names.insert(m_nameStorage.begin(), m_nameStorage.end());
+    }
+
+    PatternMatcher(const PatternMatcher &other)
+        : PatternMatcher()
+    {
+        *this = other;
+    }
+
+    PatternMatcher &operator=(const PatternMatcher &other)
+    {
+        if (this != &other)
+        {
+            m_ignoreCase = other.m_ignoreCase;
+            m_extensionStorage = other.m_extensionStorage;
+            m_nameStorage = other.m_nameStorage;
+            m_trie = other.m_trie;
+            m_globs = other.m_globs;
+            m_extensions = std::unordered_set<std::string_view>(m_extensionStorage.begin(), m_extensionStorage.end());
+            m_names = std::unordered_set<std::string_view>(m_nameStorage.begin(), m_nameStorage.end());
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Check a file name (without directories) against the patterns.
+     */
+    bool matches(std::string_view filename) const
+    {
+        return matchesExtension(filename) || matchesSuffix(filename) || matchesName(filename) || matchesGlob(filename);
+    }
+
+    /**
+     * @brief Check the file name part of a path against the patterns.
+     */
+    bool operator()(const fs::path &path) const
+    {
+        if constexpr (std::is_same_v<fs::path::value_type, char>)
+        {
+            std::string_view native = path.native();
+            size_t separator = native.find_last_of('/');
+            return matches(separator == std::string_view::npos ? native : native.substr(separator + 1));
+        }
+        else
+        {
+            return matches(path.filename().string());
+        }
+    }
+
+    bool empty() const
+    {
+        return m_extensions.empty() && m_names.empty() && m_globs.empty() && m_trie.size() == 1 && !m_trie[0].terminal;
+    }
+
+private:
+    static constexpr size_t kMaxExtension = 32;
+    static constexpr size_t kMaxName = 255;  ///< Longest file name on common file systems
+
+    struct TrieNode
+    {
+        bool terminal = false;                                  ///< A suffix ends here
+        std::vector<std::pair<unsigned char, uint32_t>> next;   ///< Child per preceding character
+    };
+
+    unsigned char fold(unsigned char c) const
+    {
+        return m_ignoreCase && c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+    }
+
+    // Helper function: insert a suffix into the trie, last character first
+    void addSuffix(std::string_view suffix)
+    {
+        uint32_t node = 0;
+        for (size_t i = suffix.size(); i-- > 0;)
+        {
+            unsigned char c = static_cast<unsigned char>(suffix[i]);
+            uint32_t child = findChild(node, c);
+            if (child == 0)
+            {
+                child = static_cast<uint32_t>(m_trie.size());
+                m_trie[node].next.emplace_back(c, child);
+                m_trie.emplace_back();
+            }
+            node = child;
+        }
+        m_trie[node].terminal = true;
+    }
+
+    uint32_t findChild(uint32_t node, unsigned char c) const
+    {
+        for (const auto &[character, child] : m_trie[node].next)
+        {
+            if (character == c)
+            {
+                return child;
+            }
+        }
+        return 0;
+    }
+
+    bool matchesExtension(std::string_view filename) const
+    {
+        if (m_extensions.empty())
+        {
+            return false;
+        }
+        // Same rule as fs::path::extension(): a leading dot starts a hidden file's name, not an extension
+        size_t dot = filename.rfind('.');
+        if (dot == std::string_view::npos || dot == 0 || filename == "..")
+        {
+            return false;
+        }
+        std::string_view extension = filename.substr(dot);
+        if (!m_ignoreCase)
+        {
+            return m_extensions.count(extension) != 0;
+        }
+        if (extension.size() > kMaxExtension)
+        {
+            return false;
+        }
+        char folded[kMaxExtension];
+        for (size_t i = 0; i < extension.size(); ++i)
+        {
+            folded[i] = static_cast<char>(fold(static_cast<unsigned char>(extension[i])));
+        }
+        return m_extensions.count(std::string_view(folded, extension.size())) != 0;
+    }
+
+    bool matchesSuffix(std::string_view filename) const
+    {
+        uint32_t node = 0;
+        if (m_trie[node].terminal)
+        {
+            return true;
+        }
+        for (size_t i = filename.size(); i-- > 0;)
+        {
+            node = findChild(node, fold(static_cast<unsigned char>(filename[i])));
+            if (node == 0)
+            {
+                return false;
+            }
+            if (m_trie[node].terminal)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool matchesName(std::string_view filename) const
+    {
+        if (m_names.empty())
+        {
+            return false;
+        }
+        if (!m_ignoreCase)
+        {
+            return m_names.count(filename) != 0;
+        }
+        if (filename.size() > kMaxName)
+        {
+            return false;
+        }
+        char folded[kMaxName];
+        for (size_t i = 0; i < filename.size(); ++i)
+        {
+            folded[i] = static_cast<char>(fold(static_cast<unsigned char>(filename[i])));
+        }
+        return m_names.count(std::string_view(folded, filename.size())) != 0;
+    }
+
+    bool matchesGlob(std::string_view filename) const
+    {
+        for (const std::string &glob : m_globs)
+        {
+            if (globMatch(glob, filename))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Helper function: glob match with "*" and "?", backtracking only to the most recent "*"
+    bool globMatch(std::string_view pattern, std::string_view text) const
+    {
+        size_t p = 0;
+        size_t t = 0;
+        size_t star = std::string_view::npos;
+        size_t star_text = 0;
+        while (t < text.size())
+        {
+            if (p < pattern.size() && (pattern[p] == '?' || static_cast<unsigned char>(pattern[p]) == fold(static_cast<unsigned char>(text[t]))))
+            {
+                ++p;
+                ++t;
+            }
+            else if (p < pattern.size() && pattern[p] == '*')
+            {
+                star = p++;
+                star_text = t;
+            }
+            else if (star != std::string_view::npos)
+            {
+                p = star + 1;
+                t = ++star_text;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    bool m_ignoreCase = false;
+    std::vector<std::string> m_extensionStorage;
+    std::vector<std::string> m_nameStorage;
+    std::vector<TrieNode> m_trie{ TrieNode() };  ///< Node 0 is the root; 0 also means "no child"
+    std::vector<std::string> m_globs;
+    std::unordered_set<std::string_view> m_extensions;
+    std::unordered_set<std::string_view> m_names;
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "BoundedQueue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Pipeline
+ * @brief Chain of stages, each with its own worker threads, connected by bounded queues.
+ *
+ * run() calls the source function on the calling thread, and the source emits jobs into the first queue. Every
+ * stage pops jobs from its input queue, processes them on as many threads as it was given, and hands each job on
+ * to the next stage or finishes it. Because the queues are bounded, a slow stage holds back the stages before it
+ * instead of letting jobs pile up in memory, and stages bound by different resources (disk, CPU) keep
+ * running at the same time.
+ *
+ * When the source returns, the first queue is closed; when the last worker of a stage exits, the next
+ * queue is closed, so the pipeline drains in order. run() blocks until every stage has drained. The first
+ * exception thrown by the source or a stage is rethrown from run() after all threads have stopped; a stage
+ * that throws loses only that job (or batch).
+ */
+template <typename Job>
+class Pipeline
+{
+public:
+    /**
+     * @brief Processes one job; returns true to pass it to the next stage, false when the job is finished.
+     */
+    using StageFunction = std::function<bool(Job &)>;
+
+    /**
+     * @brief Processes a batch of jobs; sets forward[i] to pass batch[i] to the next stage. forward starts out all false.
+     */
+    using BatchFunction = std::function<void(std::vector<Job> &batch, std::vector<bool> &forward)>;
+
+    /**
+     * @brief Receives the emit function of the first queue; emit returns false once the pipeline stops accepting jobs.
+     */
+    using SourceFunction = std::function<void(const std::function<bool(Job &&)> &emit)>;
+
+    /**
+     * @brief Receives the number of jobs waiting for each stage, in the order the stages were added.
+     */
+    using QueueSampler = std::function<void(const std::vector<size_t> &depths)>;
+
+    /**
+     * @param queue_capacity Capacity of each queue between two stages.
+     */
+    explicit Pipeline(size_t queue_capacity = 64)
+        : m_queueCapacity(std::max<size_t>(queue_capacity, 2))
+    {
+    }
+
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    /**
+     * @brief Append a stage run by the given number of threads (at least one).
+     */
+    Pipeline &addStage(std::string name, size_t workers, StageFunction function)
+    {
+        m_stages.push_back(Stage{ std::move(name), std::max<size_t>(workers, 1), std::move(function), nullptr, 1 });
+        return *this;
+    }
+
+    /**
+     * @brief Append a stage whose threads take up to max_batch jobs at a time.
+     *
+     * A thread waits for one job, then adds whatever else is already queued, so a batch never waits to fill: it
+     * is large when the stage falls behind and a single job when it keeps up. A function that throws loses the
+     * whole batch.
+     */
+    Pipeline &addBatchStage(std::string name, size_t workers, size_t max_batch, BatchFunction function)
+    {
+        m_stages.push_back(Stage{ std::move(name), std::max<size_t>(workers, 1), nullptr, std::move(function), std::max<size_t>(max_batch, 1) });
+        return *this;
+    }
+
+    /**
+     * @brief While run() runs, call sampler every interval on a thread of its own, e.g. to trace queue depths.
+     */
+    Pipeline &sampleQueues(std::chrono::microseconds interval, QueueSampler sampler)
+    {
+        m_sampleInterval = interval;
+        m_sampler = std::move(sampler);
+        return *this;
+    }
+
+    const std::string &stageName(size_t stage) const
+    {
+        return m_stages[stage].name;
+    }
+
+    /**
+     * @brief Run the source on the calling thread and block until every stage has drained.
+     *
+     * @throws The first exception thrown by the source or a stage.
+     */
+    void run(const SourceFunction &source)
+    {
+        size_t stage_count = m_stages.size();
+        std::vector<std::unique_ptr<BoundedQueue<Job>>> queues;
+        for (size_t i = 0; i < stage_count; ++i)
+        {
+            queues.push_back(std::make_unique<BoundedQueue<Job>>(m_queueCapacity));
+        }
+        std::unique_ptr<std::atomic<size_t>[]> active(new std::atomic<size_t>[stage_count]);
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < stage_count; ++i)
+        {
+            active[i].store(m_stages[i].workers);
+            for (size_t w = 0; w < m_stages[i].workers; ++w)
+            {
+                threads.emplace_back([this, i, stage_count, &queues, &active] {
+                    BoundedQueue<Job> *next = i + 1 < stage_count ? queues[i + 1].get() : nullptr;
+                    if (m_stages[i].batchFunction)
+                    {
+                        processBatches(m_stages[i], *queues[i], next);
+                    }
+                    else
+                    {
+                        processJobs(m_stages[i], *queues[i], next);
+                    }
+                    if (active[i].fetch_sub(1) == 1 && next)
+                    {
+                        next->close();
+                    }
+                });
+            }
+        }
+
+        // The depths are read without synchronization, so a sample is approximate
+        std::mutex sampler_mutex;
+        std::condition_variable sampler_wake;
+        bool sampling = true;
+        std::thread sampler;
+        if (m_sampler)
+        {
+            sampler = std::thread([&] {
+                std::vector<size_t> depths(stage_count);
+                std::unique_lock<std::mutex> lock(sampler_mutex);
+                while (!sampler_wake.wait_for(lock, m_sampleInterval, [&sampling] {
+                    return !sampling;
+                }))
+                {
+                    for (size_t i = 0; i < stage_count; ++i)
+                    {
+                        depths[i] = queues[i]->approximateSize();
+                    }
+                    try
+                    {
+                        m_sampler(depths);
+                    }
+                    catch (...)
+                    {
+                        recordError();
+                    }
+                }
+            });
+        }
+
+        if (stage_count > 0)
+        {
+            try
+            {
+                source([&queues](Job &&job) {
+                    return queues[0]->push(job);
+                });
+            }
+            catch (...)
+            {
+                recordError();
+            }
+            queues[0]->close();
+        }
+
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        if (sampler.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(sampler_mutex);
+                sampling = false;
+            }
+            sampler_wake.notify_one();
+            sampler.join();
+        }
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            error = std::exchange(m_error, nullptr);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct Stage
+    {
+        std::string name;
+        size_t workers;
+        StageFunction function;
+        BatchFunction batchFunction;  ///< Set instead of function for batch stages
+        size_t maxBatch;
+    };
+
+    void processJobs(const Stage &stage, BoundedQueue<Job> &input, BoundedQueue<Job> *next)
+    {
+        Job job;
+        while (input.pop(job))
+        {
+            bool forward = false;
+            try
+            {
+                forward = stage.function(job);
+            }
+            catch (...)
+            {
+                recordError();
+            }
+            if (forward && next)
+            {
+                next->push(job);
+            }
+        }
+    }
+
+    void processBatches(const Stage &stage, BoundedQueue<Job> &input, BoundedQueue<Job> *next)
+    {
+        std::vector<Job> batch;
+        std::vector<bool> forward;
+        Job job;
+        while (input.pop(job))
+        {
+            batch.push_back(std::move(job));
+            while (batch.size() < stage.maxBatch && input.tryPop(job))
+            {
+                batch.push_back(std::move(job));
+            }
+            forward.assign(batch.size(), false);
+            try
+            {
+                stage.batchFunction(batch, forward);
+            }
+            catch (...)
+            {
+                recordError();
+                forward.assign(batch.size(), false);
+            }
+            for (size_t i = 0; i < batch.size() && next; ++i)
+            {
+                if (forward[i])
+                {
+                    next->push(batch[i]);
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    void recordError()
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        if (!m_error)
+        {
+            m_error = std::current_exception();
+        }
+    }
+
+    size_t m_queueCapacity;
+    std::vector<Stage> m_stages;
+    std::chrono::microseconds m_sampleInterval{ 0 };
+    QueueSampler m_sampler;
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <utility>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @class Readahead
+ * @brief Asks the kernel to start reading files before the pipeline gets to them.
+ *
+ * On a cold tree every read waits for the disk, one file after another. The walker finds files well before
+ * the readers open them, so it schedules each matched file here, and up to window files are hinted at once
+ * with POSIX_FADV_WILLNEED (F_RDADVISE on macOS). The kernel reads them in the background while earlier
+ * files are converted, and the next hint goes out as each reader starts on a file. Once a file is finished,
+ * release() drops its pages with POSIX_FADV_DONTNEED, so a large run does not push everything else out of
+ * the page cache. Hints are advisory: they cost one open() each and are skipped silently if they fail. On
+ * Windows they do nothing.
+ */
+class Readahead
+{
+public:
+    static constexpr uint64_t kMaxHintBytes = 16 * 1024 * 1024;  ///< Beyond this, sequential readahead takes over
+
+    /**
+     * @param window Files hinted but not yet started at most; 0 disables the hints and release().
+     */
+    explicit Readahead(size_t window)
+        : m_window(window)
+    {
+    }
+
+    Readahead(const Readahead &) = delete;
+    Readahead &operator=(const Readahead &) = delete;
+
+    bool enabled() const
+    {
+        return m_window != 0;
+    }
+
+    /**
+     * @brief Hint a file now if the window has room, otherwise once earlier files have started.
+     */
+    void schedule(const fs::path &path)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_inFlight >= m_window)
+            {
+                m_waiting.push_back(path);
+                return;
+            }
+            ++m_inFlight;
+        }
+        willNeed(path);
+    }
+
+    /**
+     * @brief A scheduled file is being read; make room for the next one.
+     */
+    void started()
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        fs::path next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_waiting.empty())
+            {
+                if (m_inFlight > 0)
+                {
+                    --m_inFlight;
+                }
+                return;
+            }
+            next = std::move(m_waiting.front());
+            m_waiting.pop_front();
+        }
+        willNeed(next);
+    }
+
+    /**
+     * @brief Drop a finished file's cached pages; dirty pages are written back first.
+     */
+    void release(const fs::path &path) const
+    {
+        if (enabled())
+        {
+            dontNeed(path);
+        }
+    }
+
+    static void willNeed(const fs::path &path)
+    {
+#if defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            struct radvisory advice;
+            advice.ra_offset = 0;
+            advice.ra_count = static_cast<int>(kMaxHintBytes);
+            ::fcntl(fd, F_RDADVISE, &advice);
+            ::close(fd);
+        }
+#elif !defined(_WIN32)
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ::posix_fadvise(fd, 0, static_cast<off_t>(kMaxHintBytes), POSIX_FADV_WILLNEED);
+            ::close(fd);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    static void dontNeed(const fs::path &path)
+    {
+#if !defined(_WIN32) && !defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+private:
+    size_t m_window;
+    std::mutex m_mutex;
+    size_t m_inFlight = 0;              ///< Hinted files not yet started
+    std::deque<fs::path> m_waiting;     ///< Scheduled files waiting for room in the window
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "MpscQueue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+/**
+ * @class ResultSink
+ * @brief Hand-off of per-item results from worker threads to a single consumer, without making the workers wait.
+ *
+ * Workers call deliver() concurrently; it pushes the result onto a lock-free queue (see MpscQueue) and
+ * returns, so a slow consumer, e.g. one updating a window or writing to a terminal, never holds back the
+ * workers. The callback runs on a thread of the sink's own and receives results one at a time, in completion
+ * order, so it can update consumer state such as a log or a progress counter without locking of its own.
+ * The consumer thread sleeps while the queue is empty and is woken by the next delivery.
+ *
+ * Producers call flush() before returning to their caller, so that every result has been through the
+ * callback by then. An exception thrown by the callback is rethrown from the next flush().
+ */
+template <typename Result>
+class ResultSink
+{
+public:
+    using Callback = std::function<void(const Result &)>;
+
+    ResultSink() = default;
+
+    explicit ResultSink(Callback callback)
+        : m_callback(std::move(callback))
+    {
+        if (m_callback)
+        {
+            m_consumer = std::thread([this] {
+                consume();
+            });
+        }
+    }
+
+    ResultSink(const ResultSink &) = delete;
+    ResultSink &operator=(const ResultSink &) = delete;
+
+    /**
+     * @brief Passes the remaining results to the callback, then stops the consumer thread.
+     */
+    ~ResultSink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closing = true;
+        }
+        m_wake.notify_one();
+        if (m_consumer.joinable())
+        {
+            m_consumer.join();
+        }
+    }
+
+    /**
+     * @brief Queue one result for the callback.
+     */
+    void deliver(const Result &result)
+    {
+        m_delivered.fetch_add(1);
+        if (!m_callback)
+        {
+            return;
+        }
+        m_queue.push(result);
+        if (m_sleeping.load())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wake.notify_one();
+        }
+    }
+
+    /**
+     * @brief Wait until every result delivered so far has been through the callback.
+     *
+     * @throws The first exception thrown by the callback since the last flush().
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_callback)
+        {
+            size_t delivered = m_delivered.load();
+            m_consumed.wait(lock, [&] {
+                return m_handled >= delivered;
+            });
+        }
+        if (std::exception_ptr error = std::exchange(m_error, nullptr))
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Number of results delivered so far.
+     */
+    size_t delivered() const
+    {
+        return m_delivered.load();
+    }
+
+private:
+    // Helper function: the consumer thread's loop
+    void consume()
+    {
+        while (true)
+        {
+            if (std::optional<Result> result = m_queue.tryPop())
+            {
+                std::exception_ptr error;
+                try
+                {
+                    m_callback(*result);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    ++m_handled;
+                    if (error && !m_error)
+                    {
+                        m_error = error;
+                    }
+                }
+                m_consumed.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // Announce the sleep before checking the queue once more; a deliver() after that check sees the flag
+            m_sleeping.store(true);
+            m_wake.wait(lock, [this] {
+                return !m_queue.empty() || m_closing;
+            });
+            m_sleeping.store(false);
+            if (m_closing && m_queue.empty())
+            {
+                return;
+            }
+        }
+    }
+
+    Callback m_callback;
+    MpscQueue<Result> m_queue;
+    std::atomic<size_t> m_delivered{ 0 };
+    std::atomic<bool> m_sleeping{ false };  ///< The consumer waits, or is about to, for m_wake
+    std::mutex m_mutex;
+    std::condition_variable m_wake;      ///< Signals the consumer: results arrived or the sink is closing
+    std::condition_variable m_consumed;  ///< Signals flush(): a result went through the callback
+    size_t m_handled = 0;                ///< Results through the callback; guarded by m_mutex
+    bool m_closing = false;              ///< Guarded by m_mutex
+    std::exception_ptr m_error;          ///< Guarded by m_mutex
+    std::thread m_consumer;              ///< Runs the callback; only with a callback
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+/**
+ * @file Simd.hpp
+ * @brief Compile-time selection of the vector instruction sets used by the text kernels.
+ *
+ * ENCODING_CONVERTER_AVX2 and ENCODING_CONVERTER_SSE2 are defined when the compiler targets those
+ * instruction sets (-mavx2 or /arch:AVX2; SSE2 is always available on x64). Define
+ * ENCODING_CONVERTER_NO_SIMD to force the scalar code paths.
+ */
+
+#if !defined(ENCODING_CONVERTER_NO_SIMD)
+    #if defined(__AVX2__)
+        #define ENCODING_CONVERTER_AVX2 1
+    #endif
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define ENCODING_CONVERTER_SSE2 1
+    #endif
+    #if defined(__SSSE3__) || defined(__AVX__)
+        #define ENCODING_CONVERTER_SSSE3 1
+    #endif
+#endif
+
+#if defined(ENCODING_CONVERTER_AVX2) || defined(ENCODING_CONVERTER_SSSE3)
+    #include <immintrin.h>
+#elif defined(ENCODING_CONVERTER_SSE2)
+    #include <emmintrin.h>
+#endif
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "ThreadShards.hpp"
+#include "TraceRecorder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+/**
+ * @enum Stage
+ * @brief Steps of converting one file, timed separately by StageStats
+ */
+enum class Stage
+{
+    Read,     ///< Loading the file into memory
+    Detect,   ///< ASCII scan and encoding detection
+    Convert,  ///< Transcoding into the output buffer; for streamed files also their reading and writing
+    Backup,   ///< Backup file or backup pack entry
+    Write     ///< Replacing the file with the converted bytes
+};
+
+constexpr size_t kStageCount = 5;
+
+static const char *stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Read:
+        return "read";
+    case Stage::Detect:
+        return "detect";
+    case Stage::Convert:
+        return "convert";
+    case Stage::Backup:
+        return "backup";
+    case Stage::Write:
+        return "write";
+    }
+    return "unknown";
+}
+
+/**
+ * @class LatencyHistogram
+ * @brief Latency distribution in power-of-two buckets of nanoseconds.
+ *
+ * Recording is a few integer operations and no allocation, so it can run for every file. Percentiles are
+ * resolved to the upper bound of their bucket, i.e. within a factor of two, and clamped to the maximum.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t kBucketCount = 48;  ///< Bucket i holds latencies below 2^i ns; the last one also holds anything longer
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        uint64_t ns = static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+        size_t bucket = 0;
+        while (bucket + 1 < kBucketCount && (ns >> bucket) != 0)
+        {
+            ++bucket;
+        }
+        m_buckets[bucket] += 1;
+        m_count += 1;
+        m_totalNs += ns;
+        m_minNs = m_count == 1 ? ns : std::min(m_minNs, ns);
+        m_maxNs = std::max(m_maxNs, ns);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        if (other.m_count == 0)
+        {
+            return;
+        }
+        for (size_t i = 0; i < kBucketCount; ++i)
+        {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_minNs = m_count == 0 ? other.m_minNs : std::min(m_minNs, other.m_minNs);
+        m_maxNs = std::max(m_maxNs, other.m_maxNs);
+        m_count += other.m_count;
+        m_totalNs += other.m_totalNs;
+    }
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+
+    uint64_t totalNs() const
+    {
+        return m_totalNs;
+    }
+
+    uint64_t minNs() const
+    {
+        return m_minNs;
+    }
+
+    uint64_t maxNs() const
+    {
+        return m_maxNs;
+    }
+
+    /**
+     * @brief Latency below which the given fraction of the samples fall, e.g. 0.99; 0 without samples.
+     */
+    uint64_t percentileNs(double fraction) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * static_cast<double>(m_count) + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= rank)
+            {
+                return std::min(bucketLimitNs(i), m_maxNs);
+            }
+        }
+        return m_maxNs;
+    }
+
+    uint64_t bucketCount(size_t bucket) const
+    {
+        return m_buckets[bucket];
+    }
+
+    /**
+     * @brief Exclusive upper bound of a bucket in nanoseconds.
+     */
+    static uint64_t bucketLimitNs(size_t bucket)
+    {
+        return uint64_t(1) << bucket;
+    }
+
+private:
+    std::array<uint64_t, kBucketCount> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_totalNs = 0;
+    uint64_t m_minNs = 0;
+    uint64_t m_maxNs = 0;
+};
+
+/**
+ * @class StageStats
+ * @brief Per-stage latency histograms and byte counts of a conversion run.
+ *
+ * One StageStats is written by one thread only; StageStatsCollector hands each thread a shard of its own and
+ * merges the shards once the run is over, so recording needs neither locks nor atomics. A shard can also pass
+ * the stages it times on to the thread's trace.
+ */
+class StageStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(Stage stage, std::chrono::nanoseconds latency)
+    {
+        m_stages[static_cast<size_t>(stage)].record(latency);
+    }
+
+    /**
+     * @brief Record a stage that ran from start to end on the calling thread, and trace it as a slice if tracing.
+     */
+    void record(Stage stage, Clock::time_point start, Clock::time_point end)
+    {
+        record(stage, end - start);
+        if (m_trace)
+        {
+            m_trace->slice(stageName(stage), "stage", start, end);
+        }
+    }
+
+    /**
+     * @brief Trace of the thread owning this shard, or null; not merged.
+     */
+    ThreadTrace *trace() const
+    {
+        return m_trace;
+    }
+
+    void traceTo(ThreadTrace *trace)
+    {
+        m_trace = trace;
+    }
+
+    /**
+     * @brief Count a file that was read, with its size.
+     */
+    void addInput(uint64_t bytes)
+    {
+        m_files += 1;
+        m_bytesIn += bytes;
+    }
+
+    /**
+     * @brief Count the bytes of a file that was rewritten, including its BOM.
+     */
+    void addOutput(uint64_t bytes)
+    {
+        m_bytesOut += bytes;
+    }
+
+    void merge(const StageStats &other)
+    {
+        for (size_t i = 0; i < kStageCount; ++i)
+        {
+            m_stages[i].merge(other.m_stages[i]);
+        }
+        m_files += other.m_files;
+        m_bytesIn += other.m_bytesIn;
+        m_bytesOut += other.m_bytesOut;
+    }
+
+    const LatencyHistogram &stage(Stage stage) const
+    {
+        return m_stages[static_cast<size_t>(stage)];
+    }
+
+    uint64_t files() const
+    {
+        return m_files;
+    }
+
+    uint64_t bytesIn() const
+    {
+        return m_bytesIn;
+    }
+
+    uint64_t bytesOut() const
+    {
+        return m_bytesOut;
+    }
+
+    /**
+     * @brief Write the statistics as one JSON object.
+     *
+     * Latencies are in nanoseconds. Each stage lists its non-empty buckets as {"le_ns": upper bound, "count": n}.
+     */
+    void writeJson(std::ostream &out) const
+    {
+        out << "{\n";
+        out << "  \"files\": " << m_files << ",\n";
+        out << "  \"bytes_in\": " << m_bytesIn << ",\n";
+        out << "  \"bytes_out\": " << m_bytesOut << ",\n";
+        out << "  \"stages\": {";
+        for (size_t i = 0; i < kStageCount; ++i)
+        {
+            const LatencyHistogram &histogram = m_stages[i];
+            out << (i ? ",\n" : "\n") << "    \"" << stageName(static_cast<Stage>(i)) << "\": {";
+            out << "\"count\": " << histogram.count() << ", \"total_ns\": " << histogram.totalNs();
+            out << ", \"min_ns\": " << histogram.minNs() << ", \"max_ns\": " << histogram.maxNs();
+            out << ", \"mean_ns\": " << (histogram.count() ? histogram.totalNs() / histogram.count() : 0);
+            out << ", \"p50_ns\": " << histogram.percentileNs(0.50) << ", \"p90_ns\": " << histogram.percentileNs(0.90);
+            out << ", \"p99_ns\": " << histogram.percentileNs(0.99) << ", \"buckets\": [";
+            bool first = true;
+            for (size_t bucket = 0; bucket < LatencyHistogram::kBucketCount; ++bucket)
+            {
+                if (histogram.bucketCount(bucket) != 0)
+                {
+                    out << (first ? "" : ", ") << "{\"le_ns\": " << LatencyHistogram::bucketLimitNs(bucket) << ", \"count\": " << histogram.bucketCount(bucket) << "}";
+                    first = false;
+                }
+            }
+            out << "]}";
+        }
+        out << "\n  }\n}\n";
+    }
+
+private:
+    std::array<LatencyHistogram, kStageCount> m_stages;
+    uint64_t m_files = 0;
+    uint64_t m_bytesIn = 0;
+    uint64_t m_bytesOut = 0;
+    ThreadTrace *m_trace = nullptr;
+};
+
+/**
+ * @class StageStatsCollector
+ * @brief Gives every thread of a run its own StageStats and merges them at the end.
+ */
+class StageStatsCollector
+{
+public:
+    /**
+     * @param trace Optional; each thread's shard also traces its stages into the thread's trace.
+     */
+    explicit StageStatsCollector(TraceRecorder *trace = nullptr)
+        : m_shards([trace] {
+            auto shard = std::make_unique<StageStats>();
+            shard->traceTo(trace ? &trace->local() : nullptr);
+            return shard;
+        })
+    {
+    }
+
+    /**
+     * @brief The calling thread's shard, created on its first call; see ThreadShards.
+     */
+    StageStats &local()
+    {
+        return m_shards.local();
+    }
+
+    /**
+     * @brief Sum of every shard; call once the threads that record have finished.
+     */
+    StageStats merged() const
+    {
+        StageStats total;
+        m_shards.forEach([&total](const StageStats &shard) {
+            total.merge(shard);
+        });
+        return total;
+    }
+
+private:
+    ThreadShards<StageStats> m_shards;
+};
+
+/**
+ * @class StageTimer
+ * @brief Times one stage after another into a StageStats; does nothing, not even read the clock, without one.
+ *
+ * The current stage is recorded when the timer moves on with next(), is stopped, or goes out of scope,
+ * so early returns are timed too.
+ */
+class StageTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StageTimer(StageStats *stats, Stage stage)
+        : m_stats(stats)
+        , m_stage(stage)
+    {
+        if (m_stats)
+        {
+            m_started = Clock::now();
+        }
+    }
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    ~StageTimer()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Record the current stage and start timing the given one.
+     */
+    void next(Stage stage)
+    {
+        if (m_stats)
+        {
+            Clock::time_point now = Clock::now();
+            m_stats->record(m_stage, m_started, now);
+            m_started = now;
+        }
+        m_stage = stage;
+    }
+
+    /**
+     * @brief Record the current stage; the timer records nothing more.
+     */
+    void stop()
+    {
+        if (m_stats)
+        {
+            m_stats->record(m_stage, m_started, Clock::now());
+            m_stats = nullptr;
+        }
+    }
+
+private:
+    StageStats *m_stats;
+    Stage m_stage;
+    Clock::time_point m_started;
+};
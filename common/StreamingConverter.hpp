@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iconv.h>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @struct StreamingOptions
+ * @brief Tuning for the constant-memory conversion path
+ */
+struct StreamingOptions
+{
+    size_t chunkSize = 1 << 20;          ///< Bytes read from the source per iconv call
+    size_t memoryCeiling = 4 << 20;      ///< Upper bound for input plus output buffers, independent of file size
+    uint64_t threshold = 64ull << 20;    ///< Files of at least this many bytes are streamed; 0 disables streaming
+};
+
+/**
+ * @class StreamingConverter
+ * @brief Feeds a stream through iconv in fixed-size chunks.
+ *
+ * Memory use is bounded by StreamingOptions::memoryCeiling no matter how large the input is. A multibyte
+ * sequence split across two chunks (EINVAL) is carried over to the next read, and a full output buffer
+ * (E2BIG) is flushed to the output stream before iconv resumes where it stopped.
+ */
+class StreamingConverter
+{
+public:
+    explicit StreamingConverter(const StreamingOptions &options)
+    {
+        // Leave room for the output buffer, but never read less than 4 KiB at a time
+        size_t ceiling = std::max<size_t>(options.memoryCeiling, 2 * kMinBuffer);
+        m_inputSize = std::clamp<size_t>(options.chunkSize, kMinBuffer, ceiling / 2);
+        m_outputSize = ceiling - m_inputSize;
+    }
+
+    /**
+     * @brief Convert everything remaining in a stream.
+     *
+     * @param cd Open iconv descriptor in its initial shift state.
+     * @param input Stream positioned at the first byte to convert.
+     * @param output Stream receiving the converted bytes.
+     * @param error Receives a description of the failure, if any.
+     * @return true if the whole input was converted and written.
+     */
+    bool convert(iconv_t cd, std::istream &input, std::ostream &output, std::string &error) const
+    {
+        std::vector<char> in_buffer(m_inputSize);
+        std::vector<char> out_buffer(m_outputSize);
+        size_t carry = 0;
+
+        while (true)
+        {
+            input.read(in_buffer.data() + carry, static_cast<std::streamsize>(in_buffer.size() - carry));
+            size_t got = static_cast<size_t>(input.gcount());
+            if (input.bad())
+            {
+                error = "Failed to read file";
+                return false;
+            }
+            if (got == 0)
+            {
+                if (carry != 0)
+                {
+                    error = "Incomplete multibyte sequence at end of file";
+                    return false;
+                }
+                break;
+            }
+
+            char *in_ptr = in_buffer.data();
+            size_t in_left = carry + got;
+            carry = 0;
+            while (in_left > 0)
+            {
+                char *out_ptr = out_buffer.data();
+                size_t out_left = out_buffer.size();
+                size_t rc = iconv(cd, &in_ptr, &in_left, &out_ptr, &out_left);
+                int err = errno;
+                if (!flush(output, out_buffer, out_left, error))
+                {
+                    return false;
+                }
+                if (rc != (size_t)-1)
+                {
+                    break;
+                }
+                if (err == E2BIG)
+                {
+                    continue;
+                }
+                if (err == EINVAL && in_left <= kCarryReserve)
+                {
+                    // Sequence continues in the next chunk
+                    std::copy(in_ptr, in_ptr + in_left, in_buffer.data());
+                    carry = in_left;
+                    break;
+                }
+                error = "Invalid byte sequence for source encoding";
+                return false;
+            }
+        }
+
+        // Emit any closing shift sequence
+        char *out_ptr = out_buffer.data();
+        size_t out_left = out_buffer.size();
+        if (iconv(cd, nullptr, nullptr, &out_ptr, &out_left) == (size_t)-1)
+        {
+            error = "Encoding conversion failed";
+            return false;
+        }
+        return flush(output, out_buffer, out_left, error);
+    }
+
+    size_t inputBufferSize() const
+    {
+        return m_inputSize;
+    }
+
+    size_t outputBufferSize() const
+    {
+        return m_outputSize;
+    }
+
+private:
+    static constexpr size_t kMinBuffer = 4096;
+    static constexpr size_t kCarryReserve = 16;  // longer than any multibyte sequence iconv can split
+
+    static bool flush(std::ostream &output, const std::vector<char> &buffer, size_t out_left, std::string &error)
+    {
+        size_t produced = buffer.size() - out_left;
+        if (produced != 0 && !output.write(buffer.data(), static_cast<std::streamsize>(produced)))
+        {
+            error = "Failed to write file";
+            return false;
+        }
+        return true;
+    }
+
+    size_t m_inputSize = 0;
+    size_t m_outputSize = 0;
+};
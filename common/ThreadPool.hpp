@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads with one task deque per worker and work stealing.
+ *
+ * Tasks submitted from outside the pool are dealt round-robin to the workers' deques; tasks submitted by a
+ * task go to the deque of the worker running it. A worker takes its own newest task first, which keeps
+ * related work on one core, and when its deque is empty it steals the oldest task of another worker, so
+ * a few large files cannot leave the rest of the pool idle. Each deque has its own mutex, so workers only
+ * contend when they steal; the shared mutex is only taken to sleep and to wake sleeping workers.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Start the workers.
+     *
+     * @param workers Number of threads; 0 uses defaultWorkerCount().
+     */
+    explicit ThreadPool(size_t workers = 0)
+    {
+        size_t count = workers ? workers : defaultWorkerCount();
+        m_queues.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        m_threads.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_threads.emplace_back(&ThreadPool::run, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Finish all submitted tasks, then stop and join the workers.
+     */
+    ~ThreadPool()
+    {
+        waitIdle();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_workAvailable.notify_all();
+        for (std::thread &thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Hardware concurrency, or 1 if it cannot be determined.
+     */
+    static size_t defaultWorkerCount()
+    {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    size_t size() const
+    {
+        return m_threads.size();
+    }
+
+    /**
+     * @brief Queue a task for execution on one of the workers.
+     */
+    void submit(Task task)
+    {
+        size_t index = t_owner == this ? t_index : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        m_unfinished.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        m_queued.fetch_add(1);
+
+        // Taking the lock orders this wake-up after a sleeping worker's last look at m_queued
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_workAvailable.notify_one();
+    }
+
+    /**
+     * @brief Block until every submitted task has finished.
+     *
+     * @throws The first exception thrown by a task since the last wait(), if any.
+     */
+    void wait()
+    {
+        waitIdle();
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            error = std::exchange(m_error, nullptr);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_allDone.wait(lock, [this] {
+            return m_unfinished.load() == 0;
+        });
+    }
+
+    // Helper function: take the newest task of the worker's own deque, else the oldest task of another one
+    bool take(size_t index, Task &task)
+    {
+        {
+            Queue &own = *m_queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < m_queues.size(); ++offset)
+        {
+            Queue &victim = *m_queues[(index + offset) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t index)
+    {
+        t_owner = this;
+        t_index = index;
+
+        while (true)
+        {
+            Task task;
+            if (take(index, task))
+            {
+                m_queued.fetch_sub(1);
+                execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this] {
+                return m_queued.load() > 0 || m_stopping;
+            });
+            if (m_stopping && m_queued.load() <= 0)
+            {
+                return;
+            }
+        }
+    }
+
+    void execute(Task &task)
+    {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error)
+            {
+                m_error = std::current_exception();
+            }
+        }
+
+        if (m_unfinished.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_allDone.notify_all();
+        }
+    }
+
+    static inline thread_local ThreadPool *t_owner = nullptr;
+    static inline thread_local size_t t_index = 0;
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_nextQueue{ 0 };
+
+    std::atomic<ptrdiff_t> m_queued{ 0 };   ///< Tasks in the deques; briefly negative while a push is being counted
+    std::atomic<size_t> m_unfinished{ 0 };  ///< Tasks submitted and not yet finished
+
+    std::mutex m_mutex;  ///< Guards sleeping, m_stopping and m_error
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    bool m_stopping = false;
+    std::exception_ptr m_error;
+};
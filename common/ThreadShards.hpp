@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @class ThreadShards
+ * @brief One T per thread that uses it, for state a thread writes on its own and someone reads once the threads are done.
+ *
+ * local() finds the calling thread's shard with one comparison against a thread-local cache; only a thread's first
+ * call, or its first call after using another ThreadShards of the same T, takes the lock and creates a shard. Shards
+ * live as long as the ThreadShards, so forEach() can visit them after their threads have exited.
+ */
+template <typename T>
+class ThreadShards
+{
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    /**
+     * @param factory Creates each shard; called with the shards locked. By default value-initializes a T.
+     */
+    explicit ThreadShards(Factory factory = [] {
+        return std::make_unique<T>();
+    })
+        : m_id(nextId())
+        , m_factory(std::move(factory))
+    {
+    }
+
+    ThreadShards(const ThreadShards &) = delete;
+    ThreadShards &operator=(const ThreadShards &) = delete;
+
+    /**
+     * @brief The calling thread's shard, created on its first call.
+     */
+    T &local()
+    {
+        struct Cache
+        {
+            uint64_t owner = 0;
+            T *shard = nullptr;
+        };
+        thread_local Cache cache;
+        if (cache.owner != m_id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shards.push_back(m_factory());
+            cache = Cache{ m_id, m_shards.back().get() };
+        }
+        return *cache.shard;
+    }
+
+    /**
+     * @brief Call function with every shard, in the order they were created; call once the threads that write have finished.
+     */
+    void forEach(const std::function<void(const T &)> &function) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<T> &shard : m_shards)
+        {
+            function(*shard);
+        }
+    }
+
+private:
+    // Helper function: ids are never reused, unlike addresses, so a thread's cache cannot point into destroyed shards
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1);
+    }
+
+    const uint64_t m_id;
+    Factory m_factory;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_shards;
+};
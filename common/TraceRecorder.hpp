@@ -0,0 +1,260 @@
+#pragma once
+
+#include "ThreadShards.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * @class ThreadTrace
+ * @brief Trace events recorded by one thread; obtained from TraceRecorder::local().
+ */
+class ThreadTrace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ThreadTrace(size_t tid)
+        : m_tid(tid)
+    {
+    }
+
+    /**
+     * @brief Record a slice of work from start to end on this thread.
+     *
+     * @param name Slice name; must outlive the recorder, e.g. a string literal.
+     * @param category Slice category, e.g. the pipeline stage; must outlive the recorder.
+     * @param path Optional file the slice worked on; its file name then names the slice.
+     */
+    void slice(const char *name, const char *category, Clock::time_point start, Clock::time_point end, const fs::path &path = fs::path())
+    {
+        m_events.push_back(Event{ 'X', name, category, start, end, path.empty() ? std::string() : path.string(), {} });
+    }
+
+    /**
+     * @brief Record the values of a set of counters at one moment, e.g. queue depths.
+     */
+    void counter(const char *name, Clock::time_point at, const std::vector<std::pair<std::string, size_t>> &values)
+    {
+        m_events.push_back(Event{ 'C', name, "", at, at, std::string(), values });
+    }
+
+    /**
+     * @brief Name the thread in the trace, unless it already has a name.
+     */
+    void nameIfUnnamed(const char *name)
+    {
+        if (m_name.empty())
+        {
+            m_name = name;
+        }
+    }
+
+private:
+    friend class TraceRecorder;
+
+    struct Event
+    {
+        char phase;  ///< 'X' for a slice, 'C' for counters
+        const char *name;
+        const char *category;
+        Clock::time_point start;
+        Clock::time_point end;
+        std::string path;
+        std::vector<std::pair<std::string, size_t>> values;  ///< Counter values; only for 'C'
+    };
+
+    size_t m_tid;
+    std::string m_name;
+    std::vector<Event> m_events;
+};
+
+/**
+ * @class TraceRecorder
+ * @brief Collects a trace of a run in the Chrome trace event format, for chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Each thread records into a ThreadTrace of its own, so recording takes no lock; writeJson() merges them once the run
+ * is over. Timestamps are relative to the recorder's creation.
+ */
+class TraceRecorder
+{
+public:
+    using Clock = ThreadTrace::Clock;
+
+    TraceRecorder()
+        : m_origin(Clock::now())
+        , m_threads([this] {
+            return std::make_unique<ThreadTrace>(++m_threadCount);
+        })
+    {
+    }
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    /**
+     * @brief The calling thread's trace.
+     */
+    ThreadTrace &local()
+    {
+        return m_threads.local();
+    }
+
+    /**
+     * @brief Write every event as a JSON trace; call once the threads that record have finished.
+     *
+     * Slices become complete ("X") events and counters counter ("C") events, with times in microseconds. Each
+     * thread's slices are sorted by start, and enclosing slices before the ones they contain.
+     */
+    void writeJson(std::ostream &out) const
+    {
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        m_threads.forEach([&](const ThreadTrace &thread) {
+            if (!thread.m_name.empty())
+            {
+                out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.m_tid << ", \"args\": {\"name\": ";
+                writeString(out, thread.m_name);
+                out << "}}";
+                first = false;
+            }
+            std::vector<const ThreadTrace::Event *> events;
+            for (const ThreadTrace::Event &event : thread.m_events)
+            {
+                events.push_back(&event);
+            }
+            std::stable_sort(events.begin(), events.end(), [](const ThreadTrace::Event *a, const ThreadTrace::Event *b) {
+                return a->start != b->start ? a->start < b->start : a->end > b->end;
+            });
+            for (const ThreadTrace::Event *event : events)
+            {
+                out << (first ? "" : ",\n");
+                first = false;
+                writeEvent(out, thread.m_tid, *event);
+            }
+        });
+        out << "\n]}\n";
+    }
+
+private:
+    void writeEvent(std::ostream &out, size_t tid, const ThreadTrace::Event &event) const
+    {
+        out << "{\"name\": ";
+        writeString(out, event.path.empty() ? std::string(event.name) : fs::path(event.path).filename().string());
+        out << ", \"ph\": \"" << event.phase << "\", \"pid\": 1, \"tid\": " << tid << ", \"ts\": " << microseconds(event.start - m_origin);
+        if (event.phase == 'X')
+        {
+            out << ", \"dur\": " << microseconds(event.end - event.start) << ", \"cat\": ";
+            writeString(out, event.category);
+            if (!event.path.empty())
+            {
+                out << ", \"args\": {\"path\": ";
+                writeString(out, event.path);
+                out << "}";
+            }
+        }
+        else
+        {
+            out << ", \"args\": {";
+            for (size_t i = 0; i < event.values.size(); ++i)
+            {
+                out << (i ? ", " : "");
+                writeString(out, event.values[i].first);
+                out << ": " << event.values[i].second;
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+
+    // Helper function: microseconds with nanosecond precision, as the format expects
+    static std::string microseconds(Clock::duration duration)
+    {
+        long long ns = static_cast<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%lld.%03lld", ns / 1000, ns % 1000);
+        return buffer;
+    }
+
+    static void writeString(std::ostream &out, const std::string &text)
+    {
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out << escaped;
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    Clock::time_point m_origin;
+    size_t m_threadCount = 0;  ///< Threads that recorded so far; guarded by the shards' lock
+    ThreadShards<ThreadTrace> m_threads;
+};
+
+/**
+ * @class TraceSpan
+ * @brief Records a slice from its construction to its destruction; does nothing without a trace.
+ */
+class TraceSpan
+{
+public:
+    /**
+     * @param trace The calling thread's trace, or null.
+     * @param name Slice name, a string literal.
+     * @param category Slice category, a string literal; also names the thread if it has no name yet.
+     * @param path Optional file the slice works on.
+     */
+    TraceSpan(ThreadTrace *trace, const char *name, const char *category, const fs::path &path = fs::path())
+        : m_trace(trace)
+        , m_name(name)
+        , m_category(category)
+    {
+        if (m_trace)
+        {
+            m_trace->nameIfUnnamed(category);
+            m_path = path;
+            m_started = ThreadTrace::Clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    ~TraceSpan()
+    {
+        if (m_trace)
+        {
+            m_trace->slice(m_name, m_category, m_started, ThreadTrace::Clock::now(), m_path);
+        }
+    }
+
+private:
+    ThreadTrace *m_trace;
+    const char *m_name;
+    const char *m_category;
+    fs::path m_path;
+    ThreadTrace::Clock::time_point m_started;
+};
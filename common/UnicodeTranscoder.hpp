@@ -0,0 +1,470 @@
+#pragma once
+
+#include "AsciiScan.hpp"
+#include "IconvCache.hpp"
+#include "Simd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @enum UnicodeForm
+ * @brief Unicode encoding forms handled by the native transcoder
+ */
+enum class UnicodeForm
+{
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+    Utf32LE,
+    Utf32BE
+};
+
+/**
+ * @brief Map an encoding name to a UnicodeForm.
+ *
+ * Only names with an explicit byte order are accepted: "UTF-16" and "UTF-32" carry a BOM whose byte
+ * order differs between iconv implementations, so those stay with iconv.
+ *
+ * @return true if the name denotes one of the supported forms.
+ */
+inline bool unicodeFormFromName(const std::string &encoding, UnicodeForm &form)
+{
+    std::string name = IconvCache::normalizeName(encoding);
+    if (name == "UTF8")
+        form = UnicodeForm::Utf8;
+    else if (name == "UTF16LE")
+        form = UnicodeForm::Utf16LE;
+    else if (name == "UTF16BE")
+        form = UnicodeForm::Utf16BE;
+    else if (name == "UTF32LE")
+        form = UnicodeForm::Utf32LE;
+    else if (name == "UTF32BE")
+        form = UnicodeForm::Utf32BE;
+    else
+        return false;
+    return true;
+}
+
+namespace unicode_detail
+{
+    template <UnicodeForm F>
+    constexpr size_t kUnitSize = F == UnicodeForm::Utf8 ? 1 : (F == UnicodeForm::Utf16LE || F == UnicodeForm::Utf16BE) ? 2 : 4;
+
+    template <UnicodeForm F>
+    inline uint32_t loadUnit(const unsigned char *p)
+    {
+        if constexpr (F == UnicodeForm::Utf8)
+            return p[0];
+        else if constexpr (F == UnicodeForm::Utf16LE)
+            return static_cast<uint32_t>(p[0] | (p[1] << 8));
+        else if constexpr (F == UnicodeForm::Utf16BE)
+            return static_cast<uint32_t>((p[0] << 8) | p[1]);
+        else if constexpr (F == UnicodeForm::Utf32LE)
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        else
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+
+    template <UnicodeForm F>
+    inline unsigned char *storeUnit(unsigned char *out, uint32_t unit)
+    {
+        if constexpr (F == UnicodeForm::Utf8)
+        {
+            *out = static_cast<unsigned char>(unit);
+        }
+        else if constexpr (F == UnicodeForm::Utf16LE)
+        {
+            out[0] = static_cast<unsigned char>(unit);
+            out[1] = static_cast<unsigned char>(unit >> 8);
+        }
+        else if constexpr (F == UnicodeForm::Utf16BE)
+        {
+            out[0] = static_cast<unsigned char>(unit >> 8);
+            out[1] = static_cast<unsigned char>(unit);
+        }
+        else if constexpr (F == UnicodeForm::Utf32LE)
+        {
+            out[0] = static_cast<unsigned char>(unit);
+            out[1] = static_cast<unsigned char>(unit >> 8);
+            out[2] = static_cast<unsigned char>(unit >> 16);
+            out[3] = static_cast<unsigned char>(unit >> 24);
+        }
+        else
+        {
+            out[0] = static_cast<unsigned char>(unit >> 24);
+            out[1] = static_cast<unsigned char>(unit >> 16);
+            out[2] = static_cast<unsigned char>(unit >> 8);
+            out[3] = static_cast<unsigned char>(unit);
+        }
+        return out + kUnitSize<F>;
+    }
+
+    // Decode one non-ASCII code point; rejects ill-formed input, lone surrogates and values above U+10FFFF
+    template <UnicodeForm F>
+    inline bool decode(const unsigned char *&p, const unsigned char *end, uint32_t &cp)
+    {
+        if constexpr (F == UnicodeForm::Utf8)
+        {
+            unsigned char lead = p[0];
+            size_t length;
+            unsigned char lower = 0x80;
+            unsigned char upper = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                length = 2;
+                cp = lead & 0x1F;
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                length = 3;
+                cp = lead & 0x0F;
+                lower = lead == 0xE0 ? 0xA0 : 0x80;
+                upper = lead == 0xED ? 0x9F : 0xBF;
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                length = 4;
+                cp = lead & 0x07;
+                lower = lead == 0xF0 ? 0x90 : 0x80;
+                upper = lead == 0xF4 ? 0x8F : 0xBF;
+            }
+            else
+            {
+                return false;
+            }
+            if (static_cast<size_t>(end - p) < length || p[1] < lower || p[1] > upper)
+            {
+                return false;
+            }
+            cp = (cp << 6) | (p[1] & 0x3F);
+            for (size_t k = 2; k < length; ++k)
+            {
+                if ((p[k] & 0xC0) != 0x80)
+                {
+                    return false;
+                }
+                cp = (cp << 6) | (p[k] & 0x3F);
+            }
+            p += length;
+            return true;
+        }
+        else if constexpr (F == UnicodeForm::Utf16LE || F == UnicodeForm::Utf16BE)
+        {
+            uint32_t unit = loadUnit<F>(p);
+            p += 2;
+            if (unit < 0xD800 || unit > 0xDFFF)
+            {
+                cp = unit;
+                return true;
+            }
+            if (unit > 0xDBFF || end - p < 2)
+            {
+                return false;
+            }
+            uint32_t low = loadUnit<F>(p);
+            if (low < 0xDC00 || low > 0xDFFF)
+            {
+                return false;
+            }
+            p += 2;
+            cp = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+            return true;
+        }
+        else
+        {
+            cp = loadUnit<F>(p);
+            p += 4;
+            return cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF);
+        }
+    }
+
+    template <UnicodeForm F>
+    inline unsigned char *encode(unsigned char *out, uint32_t cp)
+    {
+        if constexpr (F == UnicodeForm::Utf8)
+        {
+            if (cp < 0x80)
+            {
+                *out++ = static_cast<unsigned char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                *out++ = static_cast<unsigned char>(0xC0 | (cp >> 6));
+                *out++ = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                *out++ = static_cast<unsigned char>(0xE0 | (cp >> 12));
+                *out++ = static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F));
+                *out++ = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                *out++ = static_cast<unsigned char>(0xF0 | (cp >> 18));
+                *out++ = static_cast<unsigned char>(0x80 | ((cp >> 12) & 0x3F));
+                *out++ = static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F));
+                *out++ = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+            }
+            return out;
+        }
+        else if constexpr (F == UnicodeForm::Utf16LE || F == UnicodeForm::Utf16BE)
+        {
+            if (cp < 0x10000)
+            {
+                return storeUnit<F>(out, cp);
+            }
+            cp -= 0x10000;
+            out = storeUnit<F>(out, 0xD800 + (cp >> 10));
+            return storeUnit<F>(out, 0xDC00 + (cp & 0x3FF));
+        }
+        else
+        {
+            return storeUnit<F>(out, cp);
+        }
+    }
+
+    // Number of leading units that hold ASCII characters
+    template <UnicodeForm F>
+    inline size_t asciiUnits(const unsigned char *p, size_t units)
+    {
+        if constexpr (F == UnicodeForm::Utf8)
+        {
+            return asciiPrefixLength(reinterpret_cast<const char *>(p), units);
+        }
+        else
+        {
+            size_t i = 0;
+#if defined(ENCODING_CONVERTER_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            if constexpr (kUnitSize<F> == 2)
+            {
+                const __m128i mask = _mm_set1_epi16(static_cast<short>(F == UnicodeForm::Utf16LE ? 0xFF80 : 0x80FF));
+                for (; i + 8 <= units; i += 8)
+                {
+                    __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 2)), mask);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0xFFFF)
+                    {
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                const __m128i mask = _mm_set1_epi32(static_cast<int>(F == UnicodeForm::Utf32LE ? 0xFFFFFF80u : 0x80FFFFFFu));
+                for (; i + 4 <= units; i += 4)
+                {
+                    __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 4)), mask);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, zero)) != 0xFFFF)
+                    {
+                        break;
+                    }
+                }
+            }
+#endif
+            for (; i < units && loadUnit<F>(p + i * kUnitSize<F>) < 0x80; ++i)
+            {
+            }
+            return i;
+        }
+    }
+
+    // Re-encode a run of ASCII units; widening from UTF-8 and narrowing to UTF-8 are vectorized
+    template <UnicodeForm From, UnicodeForm To>
+    inline unsigned char *copyAscii(const unsigned char *p, size_t units, unsigned char *out)
+    {
+        size_t i = 0;
+#if defined(ENCODING_CONVERTER_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        if constexpr (From == UnicodeForm::Utf8 && To != UnicodeForm::Utf8)
+        {
+            constexpr bool big_endian = To == UnicodeForm::Utf16BE || To == UnicodeForm::Utf32BE;
+            for (; i + 16 <= units; i += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+                __m128i lo = big_endian ? _mm_unpacklo_epi8(zero, v) : _mm_unpacklo_epi8(v, zero);
+                __m128i hi = big_endian ? _mm_unpackhi_epi8(zero, v) : _mm_unpackhi_epi8(v, zero);
+                if constexpr (kUnitSize<To> == 2)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), lo);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), hi);
+                    out += 32;
+                }
+                else
+                {
+                    __m128i *dst = reinterpret_cast<__m128i *>(out);
+                    _mm_storeu_si128(dst, big_endian ? _mm_unpacklo_epi16(zero, lo) : _mm_unpacklo_epi16(lo, zero));
+                    _mm_storeu_si128(dst + 1, big_endian ? _mm_unpackhi_epi16(zero, lo) : _mm_unpackhi_epi16(lo, zero));
+                    _mm_storeu_si128(dst + 2, big_endian ? _mm_unpacklo_epi16(zero, hi) : _mm_unpacklo_epi16(hi, zero));
+                    _mm_storeu_si128(dst + 3, big_endian ? _mm_unpackhi_epi16(zero, hi) : _mm_unpackhi_epi16(hi, zero));
+                    out += 64;
+                }
+            }
+        }
+        else if constexpr (To == UnicodeForm::Utf8 && kUnitSize<From> == 2)
+        {
+            for (; i + 16 <= units; i += 16)
+            {
+                const __m128i *src = reinterpret_cast<const __m128i *>(p + i * 2);
+                __m128i a = _mm_loadu_si128(src);
+                __m128i b = _mm_loadu_si128(src + 1);
+                if constexpr (From == UnicodeForm::Utf16BE)
+                {
+                    a = _mm_srli_epi16(a, 8);
+                    b = _mm_srli_epi16(b, 8);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(a, b));
+                out += 16;
+            }
+        }
+        else if constexpr (To == UnicodeForm::Utf8 && kUnitSize<From> == 4)
+        {
+            for (; i + 16 <= units; i += 16)
+            {
+                const __m128i *src = reinterpret_cast<const __m128i *>(p + i * 4);
+                __m128i v[4];
+                for (int k = 0; k < 4; ++k)
+                {
+                    v[k] = _mm_loadu_si128(src + k);
+                    if constexpr (From == UnicodeForm::Utf32BE)
+                    {
+                        v[k] = _mm_srli_epi32(v[k], 24);
+                    }
+                }
+                __m128i lo = _mm_packs_epi32(v[0], v[1]);
+                __m128i hi = _mm_packs_epi32(v[2], v[3]);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(lo, hi));
+                out += 16;
+            }
+        }
+#endif
+        const unsigned char *src = p + i * kUnitSize<From>;
+        for (; i < units; ++i, src += kUnitSize<From>)
+        {
+            out = storeUnit<To>(out, loadUnit<From>(src));
+        }
+        return out;
+    }
+
+    template <UnicodeForm From, UnicodeForm To>
+    inline bool transcode(const unsigned char *p, const unsigned char *end, unsigned char *&out)
+    {
+        constexpr size_t unit = kUnitSize<From>;
+        while (p < end)
+        {
+            size_t ascii = asciiUnits<From>(p, static_cast<size_t>(end - p) / unit);
+            out = copyAscii<From, To>(p, ascii, out);
+            p += ascii * unit;
+
+            // Non-ASCII characters tend to cluster, so stay in the scalar loop until ASCII shows up again
+            while (p < end && loadUnit<From>(p) >= 0x80)
+            {
+                uint32_t cp;
+                if (!decode<From>(p, end, cp))
+                {
+                    return false;
+                }
+                out = encode<To>(out, cp);
+            }
+        }
+        return true;
+    }
+
+    template <UnicodeForm From>
+    inline bool transcodeFrom(UnicodeForm to, const unsigned char *p, const unsigned char *end, unsigned char *&out)
+    {
+        switch (to)
+        {
+        case UnicodeForm::Utf8:
+            return transcode<From, UnicodeForm::Utf8>(p, end, out);
+        case UnicodeForm::Utf16LE:
+            return transcode<From, UnicodeForm::Utf16LE>(p, end, out);
+        case UnicodeForm::Utf16BE:
+            return transcode<From, UnicodeForm::Utf16BE>(p, end, out);
+        case UnicodeForm::Utf32LE:
+            return transcode<From, UnicodeForm::Utf32LE>(p, end, out);
+        case UnicodeForm::Utf32BE:
+            return transcode<From, UnicodeForm::Utf32BE>(p, end, out);
+        }
+        return false;
+    }
+
+    inline size_t unitSize(UnicodeForm form)
+    {
+        return form == UnicodeForm::Utf8 ? 1 : (form == UnicodeForm::Utf16LE || form == UnicodeForm::Utf16BE) ? 2 : 4;
+    }
+
+    // Largest possible output for an input of the given size
+    inline size_t maxOutputSize(UnicodeForm from, UnicodeForm to, size_t input_size)
+    {
+        size_t from_unit = unitSize(from);
+        size_t to_unit = unitSize(to);
+        if (from_unit == 1)
+            return input_size * to_unit;  // ASCII widens the most
+        if (from_unit == 2 && to_unit == 1)
+            return input_size / 2 * 3;  // a BMP character takes 3 UTF-8 bytes
+        if (from_unit == 2 && to_unit == 4)
+            return input_size * 2;
+        return input_size;
+    }
+}
+
+/**
+ * @brief Convert between UTF-8, UTF-16LE/BE and UTF-32LE/BE without iconv.
+ *
+ * Runs of ASCII are detected and re-encoded 16 characters at a time with SSE2; everything else is decoded
+ * to code points and re-encoded, with surrogate pairs combined and split as needed. Like iconv, a byte
+ * order mark in the input is converted as the character U+FEFF. The output buffer is sized once for the
+ * worst case of the pair and trimmed afterwards.
+ *
+ * @param input Bytes in the source form.
+ * @param from Source form.
+ * @param to Target form.
+ * @param output Receives the converted bytes.
+ * @return false if the input is not well-formed in the source form; output is cleared in that case.
+ */
+inline bool transcodeUnicode(std::string_view input, UnicodeForm from, UnicodeForm to, std::string &output)
+{
+    using namespace unicode_detail;
+    if (input.size() % unitSize(from) != 0)
+    {
+        output.clear();
+        return false;
+    }
+
+    output.resize(maxOutputSize(from, to, input.size()));
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(input.data());
+    const unsigned char *end = p + input.size();
+    unsigned char *begin = reinterpret_cast<unsigned char *>(&output[0]);
+    unsigned char *out = begin;
+
+    bool ok = false;
+    switch (from)
+    {
+    case UnicodeForm::Utf8:
+        ok = transcodeFrom<UnicodeForm::Utf8>(to, p, end, out);
+        break;
+    case UnicodeForm::Utf16LE:
+        ok = transcodeFrom<UnicodeForm::Utf16LE>(to, p, end, out);
+        break;
+    case UnicodeForm::Utf16BE:
+        ok = transcodeFrom<UnicodeForm::Utf16BE>(to, p, end, out);
+        break;
+    case UnicodeForm::Utf32LE:
+        ok = transcodeFrom<UnicodeForm::Utf32LE>(to, p, end, out);
+        break;
+    case UnicodeForm::Utf32BE:
+        ok = transcodeFrom<UnicodeForm::Utf32BE>(to, p, end, out);
+        break;
+    }
+
+    if (!ok)
+    {
+        output.clear();
+        return false;
+    }
+    output.resize(static_cast<size_t>(out - begin));
+    return true;
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "AsciiScan.hpp"
+#include "Simd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @struct Utf8Validation
+ * @brief Outcome of validating a buffer as UTF-8
+ */
+struct Utf8Validation
+{
+    bool valid;          ///< Whole buffer is well-formed UTF-8
+    size_t errorOffset;  ///< Offset of the first ill-formed or truncated sequence; buffer size when valid
+    bool hasMultibyte;   ///< Buffer contains at least one byte >= 0x80
+};
+
+namespace utf8_detail
+{
+    /**
+     * @brief Scalar validation from a sequence boundary.
+     *
+     * Rejects overlong forms, surrogates, code points above U+10FFFF and truncated sequences, following
+     * Table 3-7 of the Unicode standard.
+     *
+     * @return Offset of the first byte of the first invalid sequence, or size if the rest is valid.
+     */
+    inline size_t scalarInvalidOffset(const char *data, size_t size, size_t i)
+    {
+        const unsigned char *s = reinterpret_cast<const unsigned char *>(data);
+        while (i < size)
+        {
+            if (s[i] < 0x80)
+            {
+                i += asciiPrefixLength(data + i, size - i);
+                continue;
+            }
+
+            unsigned char lead = s[i];
+            size_t length;
+            unsigned char lower = 0x80;
+            unsigned char upper = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                length = 2;
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                length = 3;
+                lower = lead == 0xE0 ? 0xA0 : 0x80;
+                upper = lead == 0xED ? 0x9F : 0xBF;
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                length = 4;
+                lower = lead == 0xF0 ? 0x90 : 0x80;
+                upper = lead == 0xF4 ? 0x8F : 0xBF;
+            }
+            else
+            {
+                return i;
+            }
+
+            if (size - i < length || s[i + 1] < lower || s[i + 1] > upper)
+            {
+                return i;
+            }
+            for (size_t k = 2; k < length; ++k)
+            {
+                if ((s[i + k] & 0xC0) != 0x80)
+                {
+                    return i;
+                }
+            }
+            i += length;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Find the exact error once a vector block starting at block_start has been flagged.
+     *
+     * Everything before the block is known to be valid except for a sequence that may have started in the
+     * last three bytes of the previous block, so scalar validation resumes from that sequence's lead byte.
+     */
+    inline size_t locateError(const char *data, size_t size, size_t block_start)
+    {
+        size_t start = block_start;
+        for (size_t back = 1; back <= 3 && back <= block_start; ++back)
+        {
+            unsigned char c = static_cast<unsigned char>(data[block_start - back]);
+            if (c >= 0xC0)
+            {
+                start = block_start - back;
+                break;
+            }
+            if (c < 0x80)
+            {
+                break;
+            }
+        }
+        return scalarInvalidOffset(data, size, start);
+    }
+
+    // Error classes of the lookup algorithm (Keiser & Lemire, "Validating UTF-8 In Less Than One
+    // Instruction Per Byte", 2021). Each table maps a nibble to the errors it can take part in; a byte
+    // pair is invalid when all three lookups agree on some class.
+    constexpr uint8_t kTooShort = 1 << 0;
+    constexpr uint8_t kTooLong = 1 << 1;
+    constexpr uint8_t kOverlong3 = 1 << 2;
+    constexpr uint8_t kTooLarge = 1 << 3;
+    constexpr uint8_t kSurrogate = 1 << 4;
+    constexpr uint8_t kOverlong2 = 1 << 5;
+    constexpr uint8_t kTooLarge1000 = 1 << 6;
+    constexpr uint8_t kOverlong4 = 1 << 6;
+    constexpr uint8_t kTwoConts = 1 << 7;
+    constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+    // High nibble of the first byte of a pair
+    constexpr uint8_t kByte1High[16] = { kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTwoConts, kTwoConts,
+        kTwoConts, kTwoConts, kTooShort | kOverlong2, kTooShort, kTooShort | kOverlong3 | kSurrogate,
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4 };
+
+    // Low nibble of the first byte of a pair
+    constexpr uint8_t kByte1Low[16] = { kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2, kCarry, kCarry, kCarry | kTooLarge,
+        kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+        kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000 };
+
+    // High nibble of the second byte of a pair
+    constexpr uint8_t kByte2High[16] = { kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4, kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge, kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge, kTooShort, kTooShort,
+        kTooShort, kTooShort };
+
+#if defined(ENCODING_CONVERTER_AVX2)
+    constexpr size_t kBlock = 32;
+
+    inline __m256i table(const uint8_t (&t)[16])
+    {
+        return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(t)));
+    }
+
+    // Bytes of input shifted right by N positions, pulling in the tail of previous
+    template <int N>
+    inline __m256i prev(__m256i input, __m256i previous)
+    {
+        return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+    }
+
+    inline __m256i checkBlock(__m256i input, __m256i previous)
+    {
+        const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+        __m256i prev1 = prev<1>(input, previous);
+        __m256i byte_1_high = _mm256_shuffle_epi8(table(kByte1High), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+        __m256i byte_1_low = _mm256_shuffle_epi8(table(kByte1Low), _mm256_and_si256(prev1, low_nibble));
+        __m256i byte_2_high = _mm256_shuffle_epi8(table(kByte2High), _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        // Bytes two or three after a 3- or 4-byte lead must be continuations
+        __m256i is_third = _mm256_subs_epu8(prev<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m256i is_fourth = _mm256_subs_epu8(prev<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m256i must_continue = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        return _mm256_xor_si256(must_continue, special);
+    }
+
+    // Non-zero where a sequence starting in the last three bytes cannot be complete
+    inline __m256i incomplete(__m256i input)
+    {
+        const __m256i max_value = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        return _mm256_subs_epu8(input, max_value);
+    }
+
+    inline __m256i load(const char *p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    inline bool isZero(__m256i v)
+    {
+        return _mm256_testz_si256(v, v) != 0;
+    }
+
+    inline bool isAsciiBlock(__m256i v)
+    {
+        return _mm256_movemask_epi8(v) == 0;
+    }
+
+    using Vector = __m256i;
+
+    inline Vector zero()
+    {
+        return _mm256_setzero_si256();
+    }
+
+    inline Vector orVector(Vector a, Vector b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+#elif defined(ENCODING_CONVERTER_SSSE3)
+    constexpr size_t kBlock = 16;
+
+    inline __m128i table(const uint8_t (&t)[16])
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(t));
+    }
+
+    inline __m128i checkBlock(__m128i input, __m128i previous)
+    {
+        const __m128i low_nibble = _mm_set1_epi8(0x0F);
+        __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+        __m128i byte_1_high = _mm_shuffle_epi8(table(kByte1High), _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+        __m128i byte_1_low = _mm_shuffle_epi8(table(kByte1Low), _mm_and_si128(prev1, low_nibble));
+        __m128i byte_2_high = _mm_shuffle_epi8(table(kByte2High), _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+        __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+        __m128i is_third = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14), _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m128i is_fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m128i must_continue = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+        return _mm_xor_si128(must_continue, special);
+    }
+
+    inline __m128i incomplete(__m128i input)
+    {
+        const __m128i max_value = _mm_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        return _mm_subs_epu8(input, max_value);
+    }
+
+    inline __m128i load(const char *p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+
+    inline bool isZero(__m128i v)
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    inline bool isAsciiBlock(__m128i v)
+    {
+        return _mm_movemask_epi8(v) == 0;
+    }
+
+    using Vector = __m128i;
+
+    inline Vector zero()
+    {
+        return _mm_setzero_si128();
+    }
+
+    inline Vector orVector(Vector a, Vector b)
+    {
+        return _mm_or_si128(a, b);
+    }
+#endif
+
+#if defined(ENCODING_CONVERTER_AVX2) || defined(ENCODING_CONVERTER_SSSE3)
+    /**
+     * @brief Vector validation of data[start, size), where start is a sequence boundary.
+     */
+    inline size_t vectorInvalidOffset(const char *data, size_t size, size_t start)
+    {
+        Vector previous = zero();
+        Vector prev_incomplete = zero();
+        size_t i = start;
+        for (; i + kBlock <= size; i += kBlock)
+        {
+            Vector input = load(data + i);
+            Vector error;
+            if (isAsciiBlock(input))
+            {
+                error = prev_incomplete;
+            }
+            else
+            {
+                error = checkBlock(input, previous);
+                prev_incomplete = incomplete(input);
+            }
+            if (!isZero(error))
+            {
+                return locateError(data, size, i);
+            }
+            previous = input;
+        }
+
+        if (i < size)
+        {
+            // Zero padding reads as ASCII, which flags a sequence truncated by the end of the buffer
+            alignas(32) char tail[kBlock] = {};
+            std::memcpy(tail, data + i, size - i);
+            Vector input = load(tail);
+            Vector error = orVector(checkBlock(input, previous), prev_incomplete);
+            if (!isZero(error))
+            {
+                return locateError(data, size, i);
+            }
+        }
+        else if (!isZero(prev_incomplete))
+        {
+            return locateError(data, size, i);
+        }
+        return size;
+    }
+#endif
+}
+
+/**
+ * @brief Validate a buffer as UTF-8.
+ *
+ * Leading ASCII is skipped at memory bandwidth; the rest is checked 32 (AVX2) or 16 (SSSE3) bytes at a
+ * time with the lookup-table algorithm used by simdutf, falling back to a scalar validator on other CPUs.
+ * When a block fails, the scalar validator pins down the exact offset.
+ *
+ * @param data Bytes to validate.
+ * @param size Number of bytes.
+ * @return Utf8Validation with validity, first error offset and whether any multibyte sequence was seen.
+ */
+inline Utf8Validation validateUtf8(const char *data, size_t size)
+{
+    size_t ascii = asciiPrefixLength(data, size);
+    if (ascii == size)
+    {
+        return { true, size, false };
+    }
+
+#if defined(ENCODING_CONVERTER_AVX2) || defined(ENCODING_CONVERTER_SSSE3)
+    size_t error = utf8_detail::vectorInvalidOffset(data, size, ascii);
+#else
+    size_t error = utf8_detail::scalarInvalidOffset(data, size, ascii);
+#endif
+    return { error == size, error, true };
+}
+
+inline Utf8Validation validateUtf8(std::string_view bytes)
+{
+    return validateUtf8(bytes.data(), bytes.size());
+}